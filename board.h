@@ -70,6 +70,10 @@
 #define LINE_LED8                   PAL_LINE(GPIOB, 0U)
 #define LINE_LED9                   PAL_LINE(GPIOB, 3U)
 
+/* LPUART1 for the data link (LEQ_LINK), on the LED5 and LED6 pads. */
+#define LINE_LINK_TX                PAL_LINE(GPIOA, 2U)
+#define LINE_LINK_RX                PAL_LINE(GPIOA, 3U)
+
 /*
  * I/O ports initial setup, this configuration is established soon after reset
  * in the initialization code.
@@ -0,0 +1,64 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "calibration.h"
+#include "flash.h"
+
+#include <bit>
+#include <cstring>
+
+// Calibration page from the linker script, in double words
+extern "C" const uint64_t __cal_base__[], __cal_end__[];
+
+int calLoad(int fallback)
+{
+    int offset = fallback;
+
+    // Records are written in order, so the first erased slot ends the list
+    for (auto slot = __cal_base__; slot < __cal_end__; slot++) {
+        flashEccFault = false;
+        const uint64_t word = *slot;
+        if (flashEccFault)
+            continue;
+        if (word == FLASH_ERASED)
+            break;
+
+        const auto r = std::bit_cast<Cal_record>(word);
+        if (r.valid())
+            offset = r.offset;
+    }
+    flashEccFault = false;
+
+    return offset;
+}
+
+bool calStore(int offset)
+{
+    // Append after the last double word programmed, even a torn one
+    auto slot = __cal_end__;
+    while (slot > __cal_base__ && slot[-1] == FLASH_ERASED)
+        slot--;
+    flashEccFault = false;
+
+    if (slot == __cal_end__) {
+        if (!flashErase(__cal_base__))
+            return false;
+        slot = __cal_base__;
+    }
+
+    return flashProgram(slot, std::bit_cast<uint64_t>(Cal_record::make(offset)));
+}
+
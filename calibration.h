@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+// Per-unit calibration against a 94 dB, 1 kHz acoustic calibrator.
+//
+// For its first CAL_READINGS readings after power-up, the card checks
+// whether it is sitting in a calibrator. The A, C and Z weightings are all
+// 0 dB at 1 kHz, so a calibrator tone reads the same through each of them,
+// while ambient noise does not. If every reading agrees across weightings,
+// stays steady, and lies within CAL_RANGE of CAL_LEVEL, the offset that
+// brings the readings' energy average to CAL_LEVEL is stored in flash and
+// used from then on. Otherwise the card simply carries on measuring.
+//
+// Offsets are kept as a series of records in a flash page reserved by the
+// linker script. Each new one is appended, the page is erased only once it
+// is full, and the last record with a valid CRC is the one in force.
+
+#include "crc.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// Levels and offsets are in 0.01 dB steps
+static constexpr int      CAL_LEVEL    = 9400;
+static constexpr int      CAL_RANGE    = 600;  // Largest correction accepted
+static constexpr int      CAL_FLAT     = 30;   // Largest difference between weightings
+static constexpr int      CAL_STEADY   = 30;   // Largest LAeq spread over the readings
+static constexpr unsigned CAL_READINGS = 8;
+
+enum class Cal_state {
+    Watching,
+    Done,       // The readings so far are a calibrator tone
+    Failed,     // Not a calibrator; no more readings are checked
+};
+
+class Cal_detector {
+    unsigned seen = 0;
+    int lo = 0;
+    int hi = 0;
+
+public:
+    // Takes one reading's levels without the current offset applied
+    constexpr Cal_state feed(int laeq, int lceq, int lzeq) {
+        const auto apart = [](int a, int b, int d) { return a - b > d || b - a > d; };
+        if (apart(laeq, lceq, CAL_FLAT) || apart(laeq, lzeq, CAL_FLAT) ||
+            apart(laeq, CAL_LEVEL, CAL_RANGE))
+            return Cal_state::Failed;
+
+        lo = seen > 0 ? std::min(lo, laeq) : laeq;
+        hi = seen > 0 ? std::max(hi, laeq) : laeq;
+        if (hi - lo > CAL_STEADY)
+            return Cal_state::Failed;
+
+        return ++seen >= CAL_READINGS ? Cal_state::Done : Cal_state::Watching;
+    }
+};
+
+static_assert([] {
+    Cal_detector tone, noise, drifting;
+    auto state = Cal_state::Watching;
+    for (unsigned i = 0; i < CAL_READINGS; i++)
+        state = tone.feed(9100 + int(i % 2) * 10, 9105, 9098);
+    return state == Cal_state::Done &&
+           noise.feed(6200, 7000, 7400) == Cal_state::Failed &&
+           drifting.feed(9400, 9400, 9400) == Cal_state::Watching &&
+           drifting.feed(9450, 9450, 9450) == Cal_state::Failed;
+}());
+
+static constexpr uint16_t CAL_MAGIC = 0xCA1B;
+
+// One double word in the calibration page
+struct Cal_record {
+    uint16_t magic;
+    int16_t offset;     // Added to every reading
+    uint16_t reserved;
+    uint16_t crc;       // crc16() of the fields above
+
+    static constexpr uint16_t crcOf(const Cal_record& r) {
+        const uint8_t b[6] = { uint8_t(r.magic), uint8_t(r.magic >> 8),
+                               uint8_t(r.offset), uint8_t(uint16_t(r.offset) >> 8),
+                               uint8_t(r.reserved), uint8_t(r.reserved >> 8) };
+        return crc16(b, sizeof(b));
+    }
+
+    static constexpr Cal_record make(int offset) {
+        Cal_record r { CAL_MAGIC, int16_t(offset), 0, 0 };
+        r.crc = crcOf(r);
+        return r;
+    }
+
+    constexpr bool valid() const {
+        return magic == CAL_MAGIC && crc == crcOf(*this);
+    }
+};
+static_assert(sizeof(Cal_record) == 8);
+
+// The offset in force, or `fallback` if none was ever stored
+int calLoad(int fallback);
+// Records a new offset. Returns false on a flash error.
+bool calStore(int offset);
+
+#endif // CALIBRATION_H
+
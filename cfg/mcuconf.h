@@ -57,7 +57,11 @@
 #define STM32_HSIDIV_VALUE                  1
 #define STM32_HSI16_ENABLED                 TRUE
 #define STM32_HSE_ENABLED                   FALSE
+#if defined(LEQ_DUTY_CYCLE)
+#define STM32_LSI_ENABLED                   TRUE    /* LPTIM1 wakeup from STOP1 */
+#else
 #define STM32_LSI_ENABLED                   FALSE
+#endif
 #define STM32_LSE_ENABLED                   FALSE
 #define STM32_SW                            STM32_SW_HSISYS
 #define STM32_PLLSRC                        STM32_PLLSRC_NOCLOCK
@@ -80,7 +84,11 @@
 #define STM32_LPUART1SEL                    STM32_LPUART1SEL_PCLK
 #define STM32_I2C1SEL                       STM32_I2C1SEL_PCLK
 #define STM32_I2S1SEL                       STM32_I2S1SEL_SYSCLK
+#if defined(LEQ_DUTY_CYCLE)
+#define STM32_LPTIM1SEL                     STM32_LPTIM1SEL_LSI
+#else
 #define STM32_LPTIM1SEL                     STM32_LPTIM1SEL_PCLK
+#endif
 #define STM32_TIM1SEL                       STM32_TIM1SEL_TIMPCLK
 #define STM32_RNGSEL                        STM32_RNGSEL_HSI16
 #define STM32_RNGDIV_VALUE                  1
@@ -97,13 +105,13 @@
 
 #define STM32_IRQ_USART1_PRIORITY           2
 #define STM32_IRQ_USART2_PRIORITY           2
-#define STM32_IRQ_LPUART1_PRIORITY          2
+#define STM32_IRQ_LPUART1_PRIORITY          3
 
 #define STM32_IRQ_TIM1_UP_PRIORITY          1
 #define STM32_IRQ_TIM1_CC_PRIORITY          1
-#define STM32_IRQ_TIM2_PRIORITY             1
+#define STM32_IRQ_TIM2_PRIORITY             2
 #define STM32_IRQ_TIM3_PRIORITY             1
-#define STM32_IRQ_TIM14_PRIORITY            1
+#define STM32_IRQ_TIM14_PRIORITY            3
 #define STM32_IRQ_TIM16_PRIORITY            1
 #define STM32_IRQ_TIM17_PRIORITY            1
 
@@ -0,0 +1,40 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef CRC_H
+#define CRC_H
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-16/CCITT-FALSE, for validating flash records and link frames
+constexpr uint16_t crc16(const uint8_t *data, std::size_t len, uint16_t crc = 0xFFFF)
+{
+    while (len--) {
+        crc ^= uint16_t(*data++ << 8);
+        for (unsigned i = 0; i < 8; i++)
+            crc = crc & 0x8000 ? uint16_t((crc << 1) ^ 0x1021) : uint16_t(crc << 1);
+    }
+    return crc;
+}
+
+static_assert([] {
+    const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    return crc16(check, sizeof(check)) == 0x29B1;
+}());
+
+#endif // CRC_H
+
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ENERGY_H
+#define ENERGY_H
+
+// Sums of squares that stay accurate over long integrations. A float sum
+// stops taking in a block's energy once it is 2^24 times larger, so a Leq
+// over hours would read low.
+
+#include "sos-iir-filter.h"
+
+#include <bit>
+#include <cstdint>
+
+/**
+ * A float sum plus the rounding error of every addition to it (Neumaier's
+ * compensated summation). The error of the total stays within a few float
+ * roundings of its value, however many terms are added, for four Qfplib
+ * calls per term. Energies add to one another without that loss as well,
+ * so sums of blocks can roll up into seconds, hours and days.
+ */
+struct Energy {
+    sos_t sum;   // Running total
+    sos_t comp;  // What rounding has dropped from `sum` so far
+
+    Energy& operator+=(sos_t x) noexcept {
+        const sos_t t = sum + x;
+        // The smaller operand is the one that lost bits. Comparing bit
+        // patterns without the sign saves a soft-float compare.
+        comp += magnitude(sum) >= magnitude(x) ? (sum - t) + x : (x - t) + sum;
+        sum = t;
+        // Once the terms are all far below a bit of `sum`, `comp` takes in
+        // nearly all of each one and would round like a plain sum itself.
+        // Folding it back whenever it nears 2^-16 of `sum` keeps it small.
+        if (magnitude(comp) + (16u << 23) >= magnitude(sum))
+            fold();
+        return *this;
+    }
+
+    Energy& operator+=(const Energy& o) noexcept {
+        *this += o.sum;
+        comp += o.comp;
+        return *this;
+    }
+
+    sos_t value() const noexcept {
+        return sum + comp;
+    }
+
+private:
+    void fold() noexcept {
+        const sos_t t = sum + comp;
+        comp = (sum - t) + comp;
+        sum = t;
+    }
+
+    static uint32_t magnitude(sos_t x) noexcept {
+        return std::bit_cast<uint32_t>(float(x)) & 0x7FFFFFFF;
+    }
+};
+
+#endif // ENERGY_H
@@ -0,0 +1,84 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "hal.h"
+#include "flash.h"
+
+static constexpr uint32_t FLASH_ERRORS = FLASH_SR_OPERR | FLASH_SR_PROGERR | FLASH_SR_WRPERR |
+    FLASH_SR_PGAERR | FLASH_SR_SIZERR | FLASH_SR_PGSERR | FLASH_SR_MISERR | FLASH_SR_FASTERR;
+
+volatile bool flashEccFault = false;
+
+static void flashUnlock()
+{
+    if (FLASH->CR & FLASH_CR_LOCK) {
+        FLASH->KEYR = 0x45670123;
+        FLASH->KEYR = 0xCDEF89AB;
+    }
+}
+
+// Waits out the operation in progress, relocks, and reports its errors
+static bool flashFinish()
+{
+    while (FLASH->SR & FLASH_SR_BSY1);
+
+    const auto sr = FLASH->SR;
+    FLASH->SR = sr & (FLASH_ERRORS | FLASH_SR_EOP);
+    FLASH->CR = FLASH_CR_LOCK;
+    return !(sr & FLASH_ERRORS);
+}
+
+static void flashBegin()
+{
+    flashUnlock();
+    while (FLASH->SR & (FLASH_SR_BSY1 | FLASH_SR_CFGBSY));
+    FLASH->SR = FLASH_ERRORS;
+}
+
+bool flashErase(const void *page)
+{
+    const auto pnb = (uint32_t(page) - FLASH_BASE) / FLASH_PAGE_BYTES;
+
+    flashBegin();
+    FLASH->CR = FLASH_CR_PER | (pnb << FLASH_CR_PNB_Pos);
+    FLASH->CR |= FLASH_CR_STRT;
+    return flashFinish();
+}
+
+bool flashProgram(const void *dst, uint64_t value)
+{
+    auto words = reinterpret_cast<volatile uint32_t *>(const_cast<void *>(dst));
+
+    flashBegin();
+    FLASH->CR = FLASH_CR_PG;
+    words[0] = uint32_t(value);
+    words[1] = uint32_t(value >> 32);
+    return flashFinish();
+}
+
+// A double ECC error always raises an NMI. It is expected after a power loss
+// mid-write, so note it and carry on; anything else is fatal.
+extern "C" void NMI_Handler(void)
+{
+    if (FLASH->ECCR & FLASH_ECCR_ECCD) {
+        FLASH->ECCR |= FLASH_ECCR_ECCD;
+        flashEccFault = true;
+        return;
+    }
+
+    for (;;);
+}
+
@@ -0,0 +1,43 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef FLASH_H
+#define FLASH_H
+
+// Internal flash erase and programming. The G031 erases 2 KB pages and
+// programs one 64-bit double word at a time, each with its own ECC. Code
+// keeps running from flash meanwhile but stalls whenever it fetches from it,
+// for up to ~40 ms during an erase, so callers choose when to do this.
+
+#include "crc.h"
+
+#include <cstdint>
+
+static constexpr uint32_t FLASH_PAGE_BYTES = 2048;
+static constexpr uint64_t FLASH_ERASED     = ~uint64_t(0);
+
+// Both return false on a flash error. `page` must be page-aligned, and `dst`
+// double-word aligned and erased.
+bool flashErase(const void *page);
+bool flashProgram(const void *dst, uint64_t value);
+
+// Set by the NMI handler when a read hits an uncorrectable ECC error, which
+// is what a double word left half-programmed by a power loss looks like.
+// Clear it before reading, and distrust the data if it is set afterwards.
+extern volatile bool flashEccFault;
+
+#endif // FLASH_H
+
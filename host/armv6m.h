@@ -0,0 +1,642 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_ARMV6M_H
+#define HOST_ARMV6M_H
+
+// A small ARMv6-M (Thumb-1) interpreter for running the firmware's assembly
+// routines on the host, one call at a time. It loads ARM ELF objects or
+// executables, applies the few relocations that assembled code needs, and
+// counts cycles as a Cortex-M0+ with zero-wait-state memory would spend
+// them, which is where the STM32G031 runs its RAMFUNC code.
+//
+// Only the unprivileged instruction set is modelled: no exceptions, no
+// system registers, no peripherals. Anything else stops the call with a
+// fault message.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Armv6m
+{
+public:
+    // Cortex-M0+ cycles per instruction class (ARM DDI 0484C, table 3-1)
+    struct Timing {
+        unsigned alu = 1;        // Data processing, MOVS, ADR, extends
+        unsigned mul = 1;        // MULS with the single-cycle multiplier
+        unsigned load = 2;       // Single loads and stores
+        unsigned branch = 2;     // B, taken B<cond>, BX, writes to PC
+        unsigned bl = 3;
+    };
+
+    Timing timing;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    std::string fault;
+
+    // Addresses for objects that are placed by load() and for the stack
+    static constexpr uint32_t LOAD_BASE = 0x20000000;
+    static constexpr uint32_t STACK_TOP = 0x20100000;
+
+    // Loads an ELF file: PT_LOAD segments of an executable, or the
+    // allocated sections of a relocatable object, placed after anything
+    // loaded before. Global symbols become available to symbol() and to
+    // later objects. Returns false with `fault` set on failure.
+    bool load(const std::string& path) {
+        std::vector<uint8_t> file;
+        if (auto f = std::fopen(path.c_str(), "rb")) {
+            uint8_t buf[4096];
+            for (size_t n; (n = std::fread(buf, 1, sizeof(buf), f)) > 0;)
+                file.insert(file.end(), buf, buf + n);
+            std::fclose(f);
+        } else {
+            return error(path + ": cannot open");
+        }
+
+        Elf elf { file, path };
+        if (file.size() < 52 || std::memcmp(file.data(), "\x7f" "ELF\x01\x01", 6) != 0 ||
+            elf.u16(18) != 40)
+            return error(path + ": not a little-endian 32-bit ARM ELF file");
+
+        return elf.u16(16) == 1 ? loadObject(elf) : loadExecutable(elf);
+    }
+
+    // Address of a loaded global symbol, or 0
+    uint32_t symbol(const std::string& name) const {
+        const auto it = symbols.find(name);
+        return it != symbols.end() ? it->second : 0;
+    }
+
+    // Size in bytes that the ELF file gives a loaded global symbol, or 0
+    uint32_t symbolSize(const std::string& name) const {
+        const auto it = sizes.find(name);
+        return it != sizes.end() ? it->second : 0;
+    }
+
+    // Calls the function at `addr` with arguments in r0-r3, and any more on
+    // the stack, and returns r0. `cycles` and `instructions` count this call
+    // only. Returns 0 with `fault` set if the code does something
+    // unsupported or runs away.
+    uint32_t call(uint32_t addr, std::initializer_list<uint32_t> args,
+                  uint64_t limit = 1'000'000) {
+        r = {};
+        r[SP] = STACK_TOP - ((std::max<size_t>(args.size(), 4) - 4 + 1) & ~size_t(1)) * 4;
+        for (unsigned i = 0; auto a : args) {
+            if (i < 4)
+                r[i] = a;
+            else
+                write32(r[SP] + (i - 4) * 4, a);
+            i++;
+        }
+        r[LR] = RETURN | 1;
+        r[PC] = addr & ~1u;
+        cycles = instructions = 0;
+        fault.clear();
+
+        while (r[PC] != RETURN) {
+            if (instructions++ >= limit)
+                return error("no return after " + std::to_string(limit) + " instructions"), 0;
+            if (!step())
+                return 0;
+        }
+        return r[0];
+    }
+
+    uint32_t read32(uint32_t a) { return read16(a) | uint32_t(read16(a + 2)) << 16; }
+    uint16_t read16(uint32_t a) { return read8(a) | uint16_t(read8(a + 1)) << 8; }
+    uint8_t read8(uint32_t a) { return page(a)[a & PAGE_MASK]; }
+
+    void write32(uint32_t a, uint32_t v) { write16(a, uint16_t(v)); write16(a + 2, uint16_t(v >> 16)); }
+    void write16(uint32_t a, uint16_t v) { write8(a, uint8_t(v)); write8(a + 1, uint8_t(v >> 8)); }
+    void write8(uint32_t a, uint8_t v) { page(a)[a & PAGE_MASK] = v; }
+
+private:
+    static constexpr unsigned SP = 13, LR = 14, PC = 15;
+    static constexpr uint32_t RETURN = 0xFFFFFFF0;  // Return address of call()
+    static constexpr uint32_t PAGE_MASK = 0xFFF;
+
+    std::array<uint32_t, 16> r {};
+    bool n = false, z = false, c = false, v = false;
+    std::unordered_map<uint32_t, std::unique_ptr<uint8_t[]>> pages;
+    std::unordered_map<std::string, uint32_t> symbols;
+    std::unordered_map<std::string, uint32_t> sizes;
+    uint32_t next = LOAD_BASE;
+
+    bool error(const std::string& what) {
+        fault = what;
+        return false;
+    }
+
+    // Memory is allocated in zeroed 4 KiB pages on first touch
+    uint8_t *page(uint32_t a) {
+        auto& p = pages[a >> 12];
+        if (!p)
+            p = std::make_unique<uint8_t[]>(PAGE_MASK + 1);
+        return p.get();
+    }
+
+    // Little-endian views of an ELF file
+    struct Elf {
+        const std::vector<uint8_t>& d;
+        const std::string& path;
+
+        uint32_t u32(size_t o) const { return o + 4 <= d.size() ? d[o] | d[o + 1] << 8 | d[o + 2] << 16 | uint32_t(d[o + 3]) << 24 : 0; }
+        uint16_t u16(size_t o) const { return o + 2 <= d.size() ? d[o] | d[o + 1] << 8 : 0; }
+
+        size_t shdr(unsigned i) const { return u32(32) + size_t(i) * u16(46); }
+        unsigned shnum() const { return u16(48); }
+        uint32_t sh(unsigned i, unsigned field) const { return u32(shdr(i) + field * 4); }
+
+        const char *str(unsigned strtab, uint32_t off) const {
+            const auto o = size_t(sh(strtab, 4)) + off;
+            return o < d.size() ? reinterpret_cast<const char *>(d.data() + o) : "";
+        }
+    };
+
+    enum : unsigned { SH_NAME, SH_TYPE, SH_FLAGS, SH_ADDR, SH_OFFSET, SH_SIZE, SH_LINK, SH_INFO, SH_ALIGN };
+
+    bool loadExecutable(const Elf& elf) {
+        const auto phoff = elf.u32(28);
+        for (unsigned i = 0; i < elf.u16(44); i++) {
+            const auto ph = phoff + i * elf.u16(42);
+            if (elf.u32(ph) != 1)  // PT_LOAD
+                continue;
+            const auto off = elf.u32(ph + 4), addr = elf.u32(ph + 12);
+            const auto filesz = elf.u32(ph + 16), memsz = elf.u32(ph + 20);
+            if (size_t(off) + filesz > elf.d.size())
+                return error(elf.path + ": truncated segment");
+            for (uint32_t j = 0; j < memsz; j++)
+                write8(addr + j, j < filesz ? elf.d[off + j] : 0);
+            next = std::max(next, (addr + memsz + 15) & ~15u);
+        }
+
+        for (unsigned s = 0; s < elf.shnum(); s++) {
+            if (elf.sh(s, SH_TYPE) != 2)  // SHT_SYMTAB
+                continue;
+            for (uint32_t o = 16; o < elf.sh(s, SH_SIZE); o += 16) {
+                const auto sym = elf.sh(s, SH_OFFSET) + o;
+                if (elf.d[sym + 12] >> 4 != 0 && elf.u16(sym + 14) != 0) {  // Defined non-local
+                    const auto name = elf.str(elf.sh(s, SH_LINK), elf.u32(sym));
+                    symbols.try_emplace(name, elf.u32(sym + 4));
+                    sizes.try_emplace(name, elf.u32(sym + 8));
+                }
+            }
+        }
+        return true;
+    }
+
+    bool loadObject(const Elf& elf) {
+        // Place the allocated sections
+        std::vector<uint32_t> base (elf.shnum(), 0);
+        for (unsigned s = 1; s < elf.shnum(); s++) {
+            if (!(elf.sh(s, SH_FLAGS) & 2))  // SHF_ALLOC
+                continue;
+            const auto align = std::max<uint32_t>(elf.sh(s, SH_ALIGN), 1);
+            next = (next + align - 1) / align * align;
+            base[s] = next;
+            const auto size = elf.sh(s, SH_SIZE), off = elf.sh(s, SH_OFFSET);
+            const bool nobits = elf.sh(s, SH_TYPE) == 8;
+            if (!nobits && size_t(off) + size > elf.d.size())
+                return error(elf.path + ": truncated section");
+            for (uint32_t j = 0; j < size; j++)
+                write8(next + j, nobits ? 0 : elf.d[off + j]);
+            next += size;
+        }
+        next = (next + 15) & ~15u;
+
+        unsigned symtab = 0;
+        for (unsigned s = 1; s < elf.shnum(); s++) {
+            if (elf.sh(s, SH_TYPE) == 2)
+                symtab = s;
+        }
+        if (symtab == 0)
+            return true;
+
+        const auto strtab = elf.sh(symtab, SH_LINK);
+        auto sym = [&](uint32_t i) { return elf.sh(symtab, SH_OFFSET) + i * 16; };
+        auto value = [&](uint32_t i, uint32_t& out) {
+            const auto s = sym(i);
+            const auto shndx = elf.u16(s + 14);
+            if (shndx == 0) {
+                const auto name = elf.str(strtab, elf.u32(s));
+                const auto it = symbols.find(name);
+                if (it == symbols.end())
+                    return error(elf.path + ": undefined symbol " + name);
+                out = it->second;
+            } else {
+                out = elf.u32(s + 4) + (shndx < base.size() ? base[shndx] : 0);
+            }
+            return true;
+        };
+
+        // Globals first, so that relocations within this object resolve
+        for (uint32_t i = 1; i < elf.sh(symtab, SH_SIZE) / 16; i++) {
+            const auto s = sym(i);
+            const auto shndx = elf.u16(s + 14);
+            if (elf.d[s + 12] >> 4 != 0 && shndx != 0 && shndx < base.size() && base[shndx] != 0) {
+                const auto name = elf.str(strtab, elf.u32(s));
+                symbols.try_emplace(name, elf.u32(s + 4) + base[shndx]);
+                sizes.try_emplace(name, elf.u32(s + 8));
+            }
+        }
+
+        for (unsigned s = 1; s < elf.shnum(); s++) {
+            if (elf.sh(s, SH_TYPE) != 9)  // SHT_REL
+                continue;
+            const auto target = elf.sh(s, SH_INFO);
+            if (target >= base.size() || base[target] == 0)
+                continue;
+            for (uint32_t o = 0; o < elf.sh(s, SH_SIZE); o += 8) {
+                const auto rel = elf.sh(s, SH_OFFSET) + o;
+                const auto p = base[target] + elf.u32(rel);
+                const auto info = elf.u32(rel + 4);
+                uint32_t sv;
+                if (!value(info >> 8, sv) || !relocate(info & 0xFF, p, sv))
+                    return error(fault.empty() ? elf.path + ": relocation failed" : fault);
+            }
+        }
+        return true;
+    }
+
+    // Applies one REL relocation at `p` to a symbol at `s`
+    bool relocate(unsigned type, uint32_t p, uint32_t s) {
+        switch (type) {
+        case 0:   // R_ARM_NONE
+        case 40:  // R_ARM_V4BX
+            return true;
+        case 2:   // R_ARM_ABS32
+            write32(p, read32(p) + s);
+            return true;
+        case 3:   // R_ARM_REL32
+            write32(p, read32(p) + s - p);
+            return true;
+        case 10: { // R_ARM_THM_CALL
+            const uint32_t hi = read16(p), lo = read16(p + 2);
+            const auto off = (s & ~1u) + blOffset(hi, lo) - p;
+            const uint32_t sign = off >> 31, j1 = (~(off >> 23) ^ sign) & 1, j2 = (~(off >> 22) ^ sign) & 1;
+            write16(p, uint16_t(0xF000 | sign << 10 | ((off >> 12) & 0x3FF)));
+            write16(p + 2, uint16_t(0xD000 | j1 << 13 | j2 << 11 | ((off >> 1) & 0x7FF)));
+            return true;
+        }
+        case 102: { // R_ARM_THM_JUMP11
+            const uint32_t op = read16(p);
+            const auto off = (s & ~1u) + (uint32_t(int32_t(op << 21) >> 20)) - p;
+            write16(p, uint16_t((op & 0xF800) | ((off >> 1) & 0x7FF)));
+            return true;
+        }
+        case 103: { // R_ARM_THM_JUMP8
+            const uint32_t op = read16(p);
+            const auto off = (s & ~1u) + (uint32_t(int32_t(op << 24) >> 23)) - p;
+            write16(p, uint16_t((op & 0xFF00) | ((off >> 1) & 0xFF)));
+            return true;
+        }
+        default:
+            return error("unsupported relocation type " + std::to_string(type));
+        }
+    }
+
+    // Signed branch offset of a BL instruction, from the instruction's PC
+    static uint32_t blOffset(uint32_t hi, uint32_t lo) {
+        const uint32_t s = (hi >> 10) & 1;
+        const uint32_t i1 = ~((lo >> 13) ^ s) & 1, i2 = ~((lo >> 11) ^ s) & 1;
+        const uint32_t imm = s << 24 | i1 << 23 | i2 << 22 | (hi & 0x3FF) << 12 | (lo & 0x7FF) << 1;
+        return uint32_t(int32_t(imm << 7) >> 7) + 4;
+    }
+
+    void nz(uint32_t x) {
+        n = x >> 31;
+        z = x == 0;
+    }
+
+    uint32_t addc(uint32_t a, uint32_t b, bool carry) {
+        const uint64_t u = uint64_t(a) + b + carry;
+        const int64_t s = int64_t(int32_t(a)) + int32_t(b) + carry;
+        const auto x = uint32_t(u);
+        nz(x);
+        c = u >> 32;
+        v = int64_t(int32_t(x)) != s;
+        return x;
+    }
+
+    // LSL, LSR, ASR and ROR by a register, which sets carry from the last bit out
+    uint32_t shift(unsigned type, uint32_t x, uint32_t amount) {
+        amount &= 0xFF;
+        if (amount == 0)
+            return x;
+        switch (type) {
+        case 0:
+            c = amount <= 32 && ((x >> (32 - amount)) & 1);
+            return amount < 32 ? x << amount : 0;
+        case 1:
+            c = amount <= 32 && ((x >> (amount - 1)) & 1);
+            return amount < 32 ? x >> amount : 0;
+        case 2:
+            if (amount >= 32) {
+                c = x >> 31;
+                return uint32_t(int32_t(x) >> 31);
+            }
+            c = (x >> (amount - 1)) & 1;
+            return uint32_t(int32_t(x) >> amount);
+        default:
+            amount &= 31;
+            x = amount ? (x >> amount) | (x << (32 - amount)) : x;
+            c = x >> 31;
+            return x;
+        }
+    }
+
+    bool condition(unsigned cond) const {
+        switch (cond) {
+        case 0x0: return z;
+        case 0x1: return !z;
+        case 0x2: return c;
+        case 0x3: return !c;
+        case 0x4: return n;
+        case 0x5: return !n;
+        case 0x6: return v;
+        case 0x7: return !v;
+        case 0x8: return c && !z;
+        case 0x9: return !c || z;
+        case 0xA: return n == v;
+        case 0xB: return n != v;
+        case 0xC: return !z && n == v;
+        case 0xD: return z || n != v;
+        default:  return true;
+        }
+    }
+
+    // Interworking branch: only Thumb targets are allowed
+    bool branchTo(uint32_t target) {
+        if (target == (RETURN | 1)) {
+            r[PC] = RETURN;
+            return true;
+        }
+        if (!(target & 1))
+            return error("branch to ARM state");
+        r[PC] = target & ~1u;
+        return true;
+    }
+
+    bool undefined(uint32_t op) {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "undefined instruction %04X at %08X", op, r[PC]);
+        return error(buf);
+    }
+
+    bool step() {
+        const uint32_t pc = r[PC];
+        const uint32_t op = read16(pc);
+        const uint32_t rd = op & 7, rn = (op >> 3) & 7, rm = (op >> 6) & 7;
+        const uint32_t imm8 = op & 0xFF, rt8 = (op >> 8) & 7;
+        const uint32_t pcval = pc + 4;  // PC as read by instructions
+        r[PC] = pc + 2;
+        cycles += timing.alu;
+
+        switch (op >> 11) {
+        case 0x00: case 0x01: case 0x02: { // LSLS, LSRS, ASRS immediate
+            const uint32_t type = op >> 11, imm = (op >> 6) & 31;
+            r[rd] = shift(type, r[rn], type != 0 && imm == 0 ? 32 : imm);
+            nz(r[rd]);
+            return true;
+        }
+        case 0x03: { // ADDS/SUBS register or 3-bit immediate
+            const uint32_t b = op & 0x400 ? rm : r[rm];
+            r[rd] = op & 0x200 ? addc(r[rn], ~b, true) : addc(r[rn], b, false);
+            return true;
+        }
+        case 0x04: r[rt8] = imm8; nz(imm8); return true;              // MOVS
+        case 0x05: addc(r[rt8], ~imm8, true); return true;            // CMP
+        case 0x06: r[rt8] = addc(r[rt8], imm8, false); return true;   // ADDS
+        case 0x07: r[rt8] = addc(r[rt8], ~imm8, true); return true;   // SUBS
+        case 0x08:
+            if (!(op & 0x400))
+                return dataProcessing(op);
+            return specialData(op);
+        case 0x09: // LDR literal
+            r[rt8] = read32((pcval & ~3u) + imm8 * 4);
+            cycles += timing.load - timing.alu;
+            return true;
+        case 0x0A: case 0x0B: { // Load/store register offset
+            const uint32_t a = r[rn] + r[rm];
+            cycles += timing.load - timing.alu;
+            switch ((op >> 9) & 7) {
+            case 0: write32(a, r[rd]); break;
+            case 1: write16(a, uint16_t(r[rd])); break;
+            case 2: write8(a, uint8_t(r[rd])); break;
+            case 3: r[rd] = uint32_t(int32_t(int8_t(read8(a)))); break;
+            case 4: r[rd] = read32(a); break;
+            case 5: r[rd] = read16(a); break;
+            case 6: r[rd] = read8(a); break;
+            case 7: r[rd] = uint32_t(int32_t(int16_t(read16(a)))); break;
+            }
+            return true;
+        }
+        case 0x0C: write32(r[rn] + ((op >> 6) & 31) * 4, r[rd]); cycles += timing.load - timing.alu; return true;
+        case 0x0D: r[rd] = read32(r[rn] + ((op >> 6) & 31) * 4); cycles += timing.load - timing.alu; return true;
+        case 0x0E: write8(r[rn] + ((op >> 6) & 31), uint8_t(r[rd])); cycles += timing.load - timing.alu; return true;
+        case 0x0F: r[rd] = read8(r[rn] + ((op >> 6) & 31)); cycles += timing.load - timing.alu; return true;
+        case 0x10: write16(r[rn] + ((op >> 6) & 31) * 2, uint16_t(r[rd])); cycles += timing.load - timing.alu; return true;
+        case 0x11: r[rd] = read16(r[rn] + ((op >> 6) & 31) * 2); cycles += timing.load - timing.alu; return true;
+        case 0x12: write32(r[SP] + imm8 * 4, r[rt8]); cycles += timing.load - timing.alu; return true;
+        case 0x13: r[rt8] = read32(r[SP] + imm8 * 4); cycles += timing.load - timing.alu; return true;
+        case 0x14: r[rt8] = (pcval & ~3u) + imm8 * 4; return true;   // ADR
+        case 0x15: r[rt8] = r[SP] + imm8 * 4; return true;           // ADD Rd, SP, #imm
+        case 0x16: case 0x17:
+            return misc(op);
+        case 0x18: { // STM
+            uint32_t a = r[rt8];
+            for (unsigned i = 0; i < 8; i++) {
+                if (op & (1u << i)) {
+                    write32(a, r[i]);
+                    a += 4;
+                    cycles++;
+                }
+            }
+            r[rt8] = a;
+            return true;
+        }
+        case 0x19: { // LDM
+            uint32_t a = r[rt8];
+            for (unsigned i = 0; i < 8; i++) {
+                if (op & (1u << i)) {
+                    r[i] = read32(a);
+                    a += 4;
+                    cycles++;
+                }
+            }
+            if (!(op & (1u << rt8)))
+                r[rt8] = a;
+            return true;
+        }
+        case 0x1A: case 0x1B: { // B<cond>, UDF, SVC
+            const unsigned cond = (op >> 8) & 15;
+            if (cond >= 0xE)
+                return undefined(op);
+            if (condition(cond)) {
+                r[PC] = pcval + uint32_t(int32_t(int8_t(imm8)) * 2);
+                cycles += timing.branch - timing.alu;
+            }
+            return true;
+        }
+        case 0x1C: // B
+            r[PC] = pcval + uint32_t(int32_t(op << 21) >> 20);
+            cycles += timing.branch - timing.alu;
+            return true;
+        case 0x1E: { // BL (32-bit)
+            const uint32_t lo = read16(pc + 2);
+            if ((lo & 0xD000) != 0xD000)
+                return undefined(op);
+            r[LR] = (pc + 4) | 1;
+            r[PC] = pc + blOffset(op, lo);
+            cycles += timing.bl - timing.alu;
+            return true;
+        }
+        default:
+            return undefined(op);
+        }
+    }
+
+    bool dataProcessing(uint32_t op) {
+        const uint32_t rdn = op & 7, rm = (op >> 3) & 7;
+        uint32_t& d = r[rdn];
+        const uint32_t m = r[rm];
+        switch ((op >> 6) & 15) {
+        case 0x0: d &= m; nz(d); break;                      // ANDS
+        case 0x1: d ^= m; nz(d); break;                      // EORS
+        case 0x2: d = shift(0, d, m); nz(d); break;          // LSLS
+        case 0x3: d = shift(1, d, m); nz(d); break;          // LSRS
+        case 0x4: d = shift(2, d, m); nz(d); break;          // ASRS
+        case 0x5: d = addc(d, m, c); break;                  // ADCS
+        case 0x6: d = addc(d, ~m, c); break;                 // SBCS
+        case 0x7: d = shift(3, d, m); nz(d); break;          // RORS
+        case 0x8: nz(d & m); break;                          // TST
+        case 0x9: d = addc(~m, 0, true); break;              // RSBS #0
+        case 0xA: addc(d, ~m, true); break;                  // CMP
+        case 0xB: addc(d, m, false); break;                  // CMN
+        case 0xC: d |= m; nz(d); break;                      // ORRS
+        case 0xD: d *= m; nz(d); cycles += timing.mul - timing.alu; break; // MULS
+        case 0xE: d &= ~m; nz(d); break;                     // BICS
+        case 0xF: d = ~m; nz(d); break;                      // MVNS
+        }
+        return true;
+    }
+
+    bool specialData(uint32_t op) {
+        const uint32_t rd = (op & 7) | ((op >> 4) & 8), rm = (op >> 3) & 15;
+        const uint32_t m = rm == PC ? r[PC] + 2 : r[rm];
+        switch ((op >> 8) & 3) {
+        case 0: // ADD (high registers), no flags
+            if (rd == PC) {
+                r[PC] = (r[PC] + 2 + m) & ~1u;
+                cycles += timing.branch - timing.alu;
+            } else {
+                r[rd] += m;
+            }
+            return true;
+        case 1: // CMP (high registers)
+            addc(r[rd] + (rd == PC ? 2 : 0), ~m, true);
+            return true;
+        case 2: // MOV (high registers)
+            if (rd == PC) {
+                r[PC] = m & ~1u;
+                cycles += timing.branch - timing.alu;
+            } else {
+                r[rd] = m;
+            }
+            return true;
+        default: // BX, BLX
+            cycles += timing.branch - timing.alu;
+            if (op & 0x80)
+                r[LR] = r[PC] | 1;
+            return branchTo(m);
+        }
+    }
+
+    bool misc(uint32_t op) {
+        const uint32_t rd = op & 7, rm = (op >> 3) & 7;
+        switch ((op >> 8) & 15) {
+        case 0x0: // ADD/SUB SP, SP, #imm
+            r[SP] += (op & 0x80) ? -((op & 0x7F) * 4) : (op & 0x7F) * 4;
+            return true;
+        case 0x2: // SXTH, SXTB, UXTH, UXTB
+            switch ((op >> 6) & 3) {
+            case 0: r[rd] = uint32_t(int32_t(int16_t(r[rm]))); break;
+            case 1: r[rd] = uint32_t(int32_t(int8_t(r[rm]))); break;
+            case 2: r[rd] = r[rm] & 0xFFFF; break;
+            case 3: r[rd] = r[rm] & 0xFF; break;
+            }
+            return true;
+        case 0x4: case 0x5: { // PUSH
+            uint32_t list = (op & 0xFF) | ((op & 0x100) << 6);
+            uint32_t a = r[SP] - 4 * __builtin_popcount(list);
+            r[SP] = a;
+            for (unsigned i = 0; i < 16; i++) {
+                if (list & (1u << i)) {
+                    write32(a, r[i]);
+                    a += 4;
+                    cycles++;
+                }
+            }
+            return true;
+        }
+        case 0x6: // CPS
+            return (op & 0xFFEF) == 0xB662 ? true : undefined(op);
+        case 0xA: { // REV, REV16, REVSH
+            const uint32_t x = r[rm];
+            switch ((op >> 6) & 3) {
+            case 0: r[rd] = __builtin_bswap32(x); return true;
+            case 1: r[rd] = ((x & 0x00FF00FF) << 8) | ((x >> 8) & 0x00FF00FF); return true;
+            case 3: r[rd] = uint32_t(int32_t(int16_t(__builtin_bswap16(uint16_t(x))))); return true;
+            default: return undefined(op);
+            }
+        }
+        case 0xC: case 0xD: { // POP
+            uint32_t a = r[SP];
+            for (unsigned i = 0; i < 8; i++) {
+                if (op & (1u << i)) {
+                    r[i] = read32(a);
+                    a += 4;
+                    cycles++;
+                }
+            }
+            if (op & 0x100) {
+                const auto target = read32(a);
+                r[SP] = a + 4;
+                cycles += 1 + timing.branch;
+                return branchTo(target);
+            }
+            r[SP] = a;
+            return true;
+        }
+        case 0xE: // BKPT
+            return error("breakpoint");
+        case 0xF: // NOP and other hints
+            return (op & 0xF) == 0 ? true : undefined(op);
+        default:
+            return undefined(op);
+        }
+    }
+};
+
+#endif // HOST_ARMV6M_H
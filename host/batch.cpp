@@ -0,0 +1,270 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Recomputes the card's readings from WAV recordings, as fast as the host
+// allows. Each file is mapped rather than read, and split into chunks of
+// whole readings that are filtered on all cores at once.
+//
+// Every chunk runs the same sample conversion, equalizer and weightings as
+// Leq_accumulate(), with its own copy of the filters. A chunk first filters
+// `lead` ms of the audio before it without counting it, so its filters
+// start from the state a card would have had; the first chunk of a file
+// instead starts from zero after LEQ_SETTLE_MS, as a card does after its
+// microphone warms up. Readings cover LEQ_PERIOD filtered samples, half a
+// second as in main(), and a partial reading at the end is dropped.
+//
+// Float builds filter LANES chunks at a time per thread with the SIMD
+// kernel of sos-lanes.h, which gives the same sums as SOS_IIR_Filter; -s
+// runs one chunk at a time with SOS_IIR_Filter instead.
+//
+// Readings are printed as CSV (file, seconds, LAeq, LCeq, LZeq), where
+// seconds is the end of the reading in the recording. Throughput goes to
+// stderr, in hours of audio per second.
+//
+// Usage: batch [-s] [-j threads] [-c chunk_s] [-l lead_ms] [-o offset_dB] file.wav...
+
+#include "leq.h"
+#include "i2s.h"
+#include "wav.h"
+#if !defined(SOS_FIXED_POINT)
+#include "sos-lanes.h"
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+// Filtered samples per reading and callback periods per reading
+static constexpr unsigned READING_HALVES = LEQ_PERIOD / I2S_USESIZ;
+static_assert(LEQ_PERIOD % I2S_USESIZ == 0);
+
+struct Reading {
+    std::array<Energy, LEQ_WEIGHTINGS> sum_sqr;
+    unsigned count;
+};
+
+// One chunk's filters, copied from leq.h's before any audio has run
+struct Chain {
+    Leq_ingest in;
+    decltype(MIC_FILTER) eq = MIC_FILTER;
+    decltype(A_FILTER) a = A_FILTER;
+    decltype(C_FILTER) c = C_FILTER;
+    decltype(Z_FILTER) z = Z_FILTER;
+
+    // Filters the used frames of callback period `half`, as Leq_accumulate()
+    // would, and returns each weighting's sum
+    std::array<sos_t, LEQ_WEIGHTINGS> period(const WavView& wav, size_t half) {
+        std::array<sample_t, I2S_USESIZ> block;
+        const auto first = half * I2S_FRAMES;
+        for (unsigned i = 0; i < I2S_USESIZ; i++)
+            block[i] = in(i2sPack(wav.sample(first + i)));
+
+        auto samps = std::views::counted(block.data(), I2S_USESIZ);
+        eq.filter(samps);
+        return { a.sum_sqr_of(samps), c.sum_sqr_of(samps), z.sum_sqr_of(samps) };
+    }
+};
+
+// Readings from `first` to `last` (exclusive), each starting at callback
+// period `start + reading * READING_HALVES`
+static void runChunk(const WavView& wav, size_t start, size_t first, size_t last,
+                     size_t lead, Reading *out)
+{
+    Chain chain;
+    const auto begin = start + first * READING_HALVES;
+    for (size_t h = begin - std::min(begin, lead); h < begin; h++)
+        chain.period(wav, h);
+
+    for (size_t r = first; r < last; r++) {
+        Reading reading { {}, 0 };
+        for (size_t h = 0; h < READING_HALVES; h++) {
+            const auto sums = chain.period(wav, start + r * READING_HALVES + h);
+            for (unsigned w = 0; w < LEQ_WEIGHTINGS; w++)
+                reading.sum_sqr[w] += sums[w];
+            reading.count += I2S_USESIZ;
+        }
+        out[r] = reading;
+    }
+}
+
+#if !defined(SOS_FIXED_POINT)
+static constexpr unsigned LANES = 16;
+
+// Periods of one chunk: filtered from `from`, counted from `begin` until
+// `end`, with the first counted period starting reading `first`
+struct Span {
+    size_t from, begin, end, first;
+};
+
+// Up to LANES chunks at once, one per lane. Lanes step through their own
+// chunk's periods together; a lane past its chunk's end is fed silence.
+static void runLanes(const WavView& wav, const Span *spans, unsigned used, Reading *out)
+{
+    SOS_IIR_Lanes<MIC_DESIGN.sos.size(), LANES> eq (MIC_DESIGN);
+    SOS_IIR_Lanes<A_DESIGN.sos.size(), LANES> a (A_DESIGN);
+    SOS_IIR_Lanes<C_DESIGN.sos.size(), LANES> c (C_DESIGN);
+    SOS_IIR_Lanes<Z_DESIGN.sos.size(), LANES> z (Z_DESIGN);
+    std::array<Leq_ingest, LANES> in {};
+
+    size_t steps = 0;
+    for (unsigned l = 0; l < used; l++)
+        steps = std::max(steps, spans[l].end - spans[l].from);
+
+    std::array<Reading, LANES> readings {};
+    std::array<float, I2S_USESIZ * LANES> block;
+    for (size_t k = 0; k < steps; k++) {
+        for (unsigned l = 0; l < LANES; l++) {
+            const auto h = l < used ? spans[l].from + k : 0;
+            for (unsigned i = 0; i < I2S_USESIZ; i++) {
+                block[i * LANES + l] = l < used && h < spans[l].end ?
+                    float(in[l](i2sPack(wav.sample(h * I2S_FRAMES + i)))) : 0.f;
+            }
+        }
+
+        float sums[LEQ_WEIGHTINGS][LANES] {};
+        eq.filter(block.data(), I2S_USESIZ);
+        a.sum_sqr_of(block.data(), I2S_USESIZ, sums[LEQ_A]);
+        c.sum_sqr_of(block.data(), I2S_USESIZ, sums[LEQ_C]);
+        z.sum_sqr_of(block.data(), I2S_USESIZ, sums[LEQ_Z]);
+
+        for (unsigned l = 0; l < used; l++) {
+            const auto h = spans[l].from + k;
+            if (h < spans[l].begin || h >= spans[l].end)
+                continue;
+            auto& reading = readings[l];
+            for (unsigned w = 0; w < LEQ_WEIGHTINGS; w++)
+                reading.sum_sqr[w] += sos_t(sums[w][l]);
+            reading.count += I2S_USESIZ;
+
+            const auto n = h - spans[l].begin + 1;
+            if (n % READING_HALVES == 0)
+                out[spans[l].first + n / READING_HALVES - 1] = std::exchange(reading, {});
+        }
+    }
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    double chunk_s = 60;
+    unsigned lead_ms = 1000;
+    double offset = 0;
+    [[maybe_unused]] bool scalar = false;
+
+    for (int opt; (opt = getopt(argc, argv, "sj:c:l:o:")) != -1;) {
+        switch (opt) {
+        case 's': scalar = true; break;
+        case 'j': threads = std::max(1, std::atoi(optarg)); break;
+        case 'c': chunk_s = std::atof(optarg); break;
+        case 'l': lead_ms = unsigned(std::atoi(optarg)); break;
+        case 'o': offset = std::atof(optarg); break;
+        default:  chunk_s = 0; break;
+        }
+    }
+    if (optind >= argc || chunk_s <= 0) {
+        std::fprintf(stderr, "usage: %s [-s] [-j threads] [-c chunk_s] [-l lead_ms] [-o offset_dB] "
+            "file.wav...\n", argv[0]);
+        return 1;
+    }
+
+    Leq_calibrate(sos_t(float(offset)));
+
+    const auto per_chunk = std::max<size_t>(1, size_t(chunk_s * SAMPLE_RATE / I2S_FRAMES) /
+        READING_HALVES);
+    const auto lead = i2sHalvesFor(lead_ms);
+
+    double audio = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    std::printf("file,seconds,LAeq,LCeq,LZeq\n");
+
+    int ret = 0;
+    for (int i = optind; i < argc; i++) {
+        const char *path = argv[i];
+        WavMap map;
+        if (!map.open(path)) {
+            std::fprintf(stderr, "%s: unsupported or unreadable WAV file\n", path);
+            ret = 1;
+            continue;
+        }
+        const auto& wav = map.view;
+        if (wav.rate != SAMPLE_RATE) {
+            std::fprintf(stderr, "%s: warning: %u Hz input, filters are designed for %u Hz\n",
+                path, wav.rate, SAMPLE_RATE);
+        }
+        audio += double(wav.frames) / wav.rate;
+
+        // Readings start once the filters have settled, as in i2sProcess()
+        const size_t halves = wav.frames / I2S_FRAMES;
+        const size_t start = LEQ_SETTLE_HALVES;
+        const size_t count = halves > start ? (halves - start) / READING_HALVES : 0;
+        const size_t chunks = (count + per_chunk - 1) / per_chunk;
+        std::vector<Reading> readings (count);
+
+        std::atomic<size_t> next {0};
+        auto worker = [&] {
+#if !defined(SOS_FIXED_POINT)
+            if (!scalar) {
+                for (size_t c; (c = next.fetch_add(LANES)) < chunks;) {
+                    Span spans[LANES];
+                    const auto used = unsigned(std::min<size_t>(LANES, chunks - c));
+                    for (unsigned l = 0; l < used; l++) {
+                        const auto first = (c + l) * per_chunk;
+                        const auto begin = start + first * READING_HALVES;
+                        const auto from = begin - std::min<size_t>(begin, c + l == 0 ? start : lead);
+                        const auto end = start + std::min(count, first + per_chunk) * READING_HALVES;
+                        spans[l] = { from, begin, end, first };
+                    }
+                    runLanes(wav, spans, used, readings.data());
+                }
+                return;
+            }
+#endif
+            for (size_t c; (c = next++) < chunks;) {
+                runChunk(wav, start, c * per_chunk, std::min(count, (c + 1) * per_chunk),
+                    c == 0 ? start : lead, readings.data());
+            }
+        };
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < std::min<size_t>(threads, chunks); t++)
+            pool.emplace_back(worker);
+        worker();
+        for (auto& t : pool)
+            t.join();
+
+        for (size_t r = 0; r < count; r++) {
+            const double end = double((start + (r + 1) * READING_HALVES) * I2S_FRAMES) / SAMPLE_RATE;
+            std::printf("%s,%.1f", path, end);
+            for (unsigned w = 0; w < LEQ_WEIGHTINGS; w++)
+                std::printf(",%.2f", float(Leq_to_dB(readings[r].sum_sqr[w], readings[r].count)));
+            std::printf("\n");
+        }
+    }
+
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::fprintf(stderr, "%.2f h of audio in %.2f s on %u threads: %.2f h/s, %.0fx real time\n",
+        audio / 3600, seconds, threads, audio / 3600 / seconds, audio / seconds);
+    return ret;
+}
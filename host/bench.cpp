@@ -0,0 +1,242 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Feeds WAV files through the firmware's Leq_accumulate() one callback period
+// at a time and reports throughput along with the Leq readings produced.
+//
+// With -p, each stage of Leq_accumulate() is also timed, as in the
+// firmware's LEQ_PROFILE build, and its min/mean/max time is printed.
+//
+// With -s, readings follow a duty-cycled schedule like the firmware's
+// LEQ_DUTY_CYCLE build: each reading covers `burst` ms of audio after the
+// microphone warmup and filter settling, and readings start every `period`
+// ms. Audio between bursts is skipped, and the energy average of all
+// readings is printed along with the schedule's estimated supply current.
+// The default is LEQ_SCHEDULE.
+//
+// Usage: bench [-q] [-p] [-r repeats] [-s burst:period] file.wav...
+
+#include "leq.h"
+#include "i2s.h"
+#include "profile.h"
+#include "wav.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+static constexpr unsigned HALFSIZE = I2S_FRAMES * 2; // Words per callback period
+
+static const char *STAGE_NAMES[LEQ_STAGES] = {
+    "convert", "equalize", "weight A", "weight C", "weight Z"
+};
+
+static uint32_t nanoseconds()
+{
+    return uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+struct Reading {
+    std::array<Energy, LEQ_WEIGHTINGS> sum_sqr;
+    unsigned count;
+    double seconds;  // Time of the reading from the start of the audio
+};
+
+struct Run {
+    std::vector<Reading> readings;
+    Profile<LEQ_STAGES> profile;
+    unsigned long processed = 0;
+    double seconds = 0;
+};
+
+static Run runOnce(const std::vector<uint32_t>& frames, bool profile, const Schedule& schedule)
+{
+    const auto& buffer = frames;
+    const auto halves = buffer.size() / HALFSIZE;
+    const auto burst = i2sHalvesFor(schedule.burst_ms) * I2S_USESIZ;
+    Run run;
+    run.profile.setBudget(uint64_t(1'000'000'000) * I2S_FRAMES / SAMPLE_RATE);
+
+    // Fresh filter state for every run
+    Leq_input = {};
+    for (auto& w : MIC_FILTER.w) w = {};
+    for (auto& w : A_FILTER.w) w = {};
+    for (auto& w : C_FILTER.w) w = {};
+    for (auto& w : Z_FILTER.w) w = {};
+    Leq_sum_sqr = {};
+    Leq_samples = 0;
+
+    // Mirror i2sCallback(): each time the I2S clock starts, mic warmup is
+    // skipped, then filters settle before samples count. Filter state is
+    // kept across bursts, as in the firmware.
+    size_t begin = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t h = 0; h < halves; h++) {
+        const auto half = h - begin;
+        if (half < MIC_WARMUP_HALVES)
+            continue;
+        if (half == MIC_WARMUP_HALVES + LEQ_SETTLE_HALVES) {
+            Leq_sum_sqr = {};
+            Leq_samples = 0;
+        }
+
+        if (profile) {
+            uint32_t marks[LEQ_STAGES];
+            const auto start = nanoseconds();
+            Leq_accumulate(buffer.data() + h * HALFSIZE,
+                [&marks](Leq_stage s) { marks[s] = nanoseconds(); });
+            run.profile.record(start, marks, marks[LEQ_STAGES - 1]);
+        } else {
+            Leq_accumulate(buffer.data() + h * HALFSIZE);
+        }
+        run.processed += I2S_USESIZ;
+
+        if (half >= MIC_WARMUP_HALVES + LEQ_SETTLE_HALVES && Leq_samples >= burst) {
+            run.readings.push_back({ std::exchange(Leq_sum_sqr, {}),
+                                     std::exchange(Leq_samples, 0),
+                                     double((h + 1) * I2S_FRAMES) / SAMPLE_RATE });
+
+            // Stop until the next period starts
+            if (!schedule.continuous()) {
+                begin += i2sHalvesFor(schedule.period_ms);
+                h = begin - 1;
+            }
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    run.seconds = std::chrono::duration<double>(end - start).count();
+    return run;
+}
+
+int main(int argc, char *argv[])
+{
+    bool quiet = false;
+    bool profile = false;
+    unsigned repeats = 5;
+    Schedule schedule = LEQ_SCHEDULE;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg (argv[i]);
+        if (arg == "-q")
+            quiet = true;
+        else if (arg == "-p")
+            profile = true;
+        else if (arg == "-r" && i + 1 < argc)
+            repeats = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "-s" && i + 1 < argc &&
+                 std::sscanf(argv[++i], "%u:%u", &schedule.burst_ms, &schedule.period_ms) == 2)
+            continue;
+        else
+            files.push_back(arg);
+    }
+
+    if (files.empty() || schedule.burst_ms == 0) {
+        std::fprintf(stderr, "usage: %s [-q] [-p] [-r repeats] [-s burst:period] file.wav...\n",
+            argv[0]);
+        return 1;
+    }
+    if (!schedule.continuous() && schedule.active_ms() > schedule.period_ms) {
+        std::fprintf(stderr, "%s: %u ms burst plus %u ms warmup and settling exceeds the %u ms period\n",
+            argv[0], schedule.burst_ms, MIC_WARMUP_MS + LEQ_SETTLE_MS, schedule.period_ms);
+        return 1;
+    }
+
+    int ret = 0;
+    for (const auto& path : files) {
+        WavFile wav;
+        if (!wavRead(path, wav)) {
+            std::fprintf(stderr, "%s: unsupported or unreadable WAV file\n", path.c_str());
+            ret = 1;
+            continue;
+        }
+        if (wav.rate != SAMPLE_RATE) {
+            std::fprintf(stderr, "%s: warning: %u Hz input, filters are designed for %u Hz\n",
+                path.c_str(), wav.rate, SAMPLE_RATE);
+        }
+
+        const auto frames = i2sFrames(wav.samples);
+
+        // Keep the fastest run; readings are identical across repeats
+        Run best;
+        for (unsigned r = 0; r < repeats; r++) {
+            auto run = runOnce(frames, profile, schedule);
+            if (r == 0 || run.seconds < best.seconds)
+                best = std::move(run);
+        }
+
+        const double audio = double(wav.samples.size()) / wav.rate;
+        std::printf("%s: %.2f s audio, %lu samples filtered (%u of %u per callback)\n",
+            path.c_str(), audio, best.processed, I2S_USESIZ, I2S_FRAMES);
+        std::printf("  %.0f samples/sec, %.2f ns/sample, %.0fx real time\n",
+            best.processed / best.seconds, best.seconds * 1e9 / best.processed,
+            audio / best.seconds);
+
+        if (profile) {
+            const auto& p = best.profile;
+            for (unsigned i = 0; i < LEQ_STAGES; i++) {
+                std::printf("  %-9s %7u min %7u mean %7u max ns per callback\n", STAGE_NAMES[i],
+                    p.stages[i].min, p.stages[i].mean(), p.stages[i].max);
+            }
+            std::printf("  %-9s %7u min %7u mean %7u max ns, %u of %u over the %u ns deadline\n",
+                "total", p.total.min, p.total.mean(), p.total.max, p.overruns, p.runs, p.budget);
+        }
+
+        std::array<Energy, LEQ_WEIGHTINGS> total {};
+        unsigned long count = 0;
+        for (const auto& r : best.readings) {
+            if (!quiet) {
+                std::printf("  %8.2f s  LAeq %6.2f  LCeq %6.2f  LZeq %6.2f dB\n", r.seconds,
+                    float(Leq_to_dB(r.sum_sqr[LEQ_A], r.count)),
+                    float(Leq_to_dB(r.sum_sqr[LEQ_C], r.count)),
+                    float(Leq_to_dB(r.sum_sqr[LEQ_Z], r.count)));
+            }
+            for (unsigned i = 0; i < LEQ_WEIGHTINGS; i++)
+                total[i] += r.sum_sqr[i];
+            count += r.count;
+        }
+        std::printf("  %zu readings", best.readings.size());
+        if (count > 0) {
+            std::printf(", overall LAeq %.2f  LCeq %.2f  LZeq %.2f dB",
+                float(Leq_to_dB(total[LEQ_A], count)),
+                float(Leq_to_dB(total[LEQ_C], count)),
+                float(Leq_to_dB(total[LEQ_Z], count)));
+        }
+        std::printf("\n");
+    }
+
+    if (schedule.continuous()) {
+        std::printf("schedule: continuous, %u ms readings, ", schedule.burst_ms);
+    } else {
+        std::printf("schedule: %u ms bursts every %u ms (%u ms active), ",
+            schedule.burst_ms, schedule.period_ms, schedule.active_ms());
+    }
+    std::printf("est. %.0f-%.0f uA\n",
+        scheduleCurrent(schedule, 0), scheduleCurrent(schedule, 1));
+    std::printf("geometry: %u of %u frames per callback, %u B sample RAM, %.1f callbacks/s\n",
+        I2S_GEOMETRY.used, I2S_GEOMETRY.frames, I2S_GEOMETRY.ram_bytes(),
+        I2S_GEOMETRY.irq_hz(SAMPLE_RATE));
+
+    return ret;
+}
+
@@ -0,0 +1,234 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Runs the Thumb-1 kernel of sos-unpacked.s in an ARMv6-M emulator
+// (armv6m.h) and checks it bit for bit against the C++ model of the
+// SOS_UNPACKED backend in sos-iir-filter.h. The object is built for the
+// Cortex-M0+ by `make cascade`.
+//
+// leq.h's equalizer and A, C and Z weightings each filter silence, an
+// impulse, noise at several levels, tones, a full-scale square wave and
+// random 32-bit words, one block at a time. Every output sample, the delay
+// state after each block and each block's sum of squares must match the
+// model; every other block is filtered in place, as Leq_accumulate() does.
+//
+// Cycles are counted as a Cortex-M0+ executing from zero-wait-state RAM,
+// and printed per sample and per section-sample. If qfplib-port.h's
+// routines are also loaded (qfp-port.o), the same sections are timed on
+// packed floats for comparison, as SOS_IIR_Filter would call them.
+//
+// Usage: cascade-check [-s seconds] object...
+
+#include "leq.h"
+#include "test-signals.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static constexpr unsigned BLOCK = 64;
+
+// Where the kernel's arguments are placed in the emulator
+static constexpr uint32_t COEFFS = 0x20080000;
+static constexpr uint32_t STATE  = 0x20081000;
+static constexpr uint32_t IN     = 0x20082000;
+static constexpr uint32_t OUT    = 0x20083000;
+static constexpr uint32_t ACC    = 0x20084000;
+
+struct Totals {
+    uint64_t samples = 0, sections = 0, cycles = 0;
+    uint64_t sum_samples = 0, sum_cycles = 0;
+    double float_cycles = 0;  // Per section-sample, if timed
+};
+
+class Check
+{
+public:
+    Armv6m& cpu;
+    uint32_t cascade, sum_sqr, fadd, fmul;
+    unsigned mismatches = 0;
+    bool faulted = false;
+
+    template<std::size_t N>
+    Totals run(const char *name, const SOS_IIR_Filter<N>& design, const std::vector<Signal<int32_t>>& sigs) {
+        Totals t;
+        if constexpr (N == 0) {
+            std::printf("%-10s %8zu  (gain only, no kernel call)\n", name, N);
+            return t;
+        }
+        for (const auto& s : sigs)
+            runSignal(name, sos_filter_cast<sos_u>(design), s, t);
+        if (fadd && fmul)
+            t.float_cycles = timeFloat(design, sigs[2].x);
+
+        std::printf("%-10s %8zu %12.1f %14.1f", name, N, double(t.cycles) / t.samples,
+            double(t.cycles) / t.sections);
+        if (t.float_cycles > 0)
+            std::printf(" %14.1f %7.2fx", t.float_cycles, t.float_cycles / (double(t.cycles) / t.sections));
+        std::printf("\n");
+        return t;
+    }
+
+private:
+    template<std::size_t N>
+    void runSignal(const char *name, SOS_IIR_Filter<N, sos_u> model, const Signal<int32_t>& sig, Totals& t) {
+        std::array<SOS_Delay_State_U, N> state {};
+        writeWords(cpu, COEFFS, model.sos.data(), sizeof(model.sos));
+        writeWords(cpu, STATE, state.data(), sizeof(state));
+
+        unsigned shown = 0;
+        for (std::size_t i = 0; i + BLOCK <= sig.x.size(); i += BLOCK) {
+            std::array<sos_u, BLOCK> in, want, got;
+            for (unsigned j = 0; j < BLOCK; j++)
+                in[j] = sos_u_from_int(sig.x[i + j]);
+            sos_u_cascade(model.sos.data(), model.w.data(), N, in.data(), want.data(), BLOCK);
+            sos_u want_acc { 0, 0 }, got_acc;
+            sos_u_sum_sqr(want.data(), BLOCK, &want_acc);
+
+            const bool in_place = i / BLOCK % 2;
+            const auto out = in_place ? IN : OUT;
+            writeWords(cpu, IN, in.data(), sizeof(in));
+            cpu.write32(ACC, 0);
+            cpu.write32(ACC + 4, 0);
+            cpu.call(cascade, { COEFFS, STATE, uint32_t(N), IN, out, BLOCK });
+            t.cycles += cpu.cycles;
+            if (!cpu.fault.empty())
+                return fault(name, sig.name, i);
+            cpu.call(sum_sqr, { out, BLOCK, ACC });
+            t.sum_cycles += cpu.cycles;
+            if (!cpu.fault.empty())
+                return fault(name, sig.name, i);
+            t.samples += BLOCK;
+            t.sections += BLOCK * N;
+            t.sum_samples += BLOCK;
+
+            readWords(cpu, out, got.data(), sizeof(got));
+            readWords(cpu, STATE, state.data(), sizeof(state));
+            readWords(cpu, ACC, &got_acc, sizeof(got_acc));
+
+            for (unsigned j = 0; j < BLOCK; j++) {
+                if (got[j].m != want[j].m || got[j].e != want[j].e)
+                    report(shown, name, sig.name, i + j, "output", got[j], want[j]);
+            }
+            for (std::size_t k = 0; k < N; k++) {
+                const auto& g = state[k];
+                const auto& w = model.w[k];
+                if (g.m0 != w.m0 || g.e0 != w.e0 || g.m1 != w.m1 || g.e1 != w.e1)
+                    report(shown, name, sig.name, i, "state", { g.m0, g.e0 }, { w.m0, w.e0 });
+            }
+            if (got_acc.m != want_acc.m || got_acc.e != want_acc.e)
+                report(shown, name, sig.name, i, "sum of squares", got_acc, want_acc);
+        }
+    }
+
+    // Mean cycles per section-sample of SOS_IIR_Filter's eight qfplib calls
+    template<std::size_t N>
+    double timeFloat(SOS_IIR_Filter<N> f, const std::vector<int32_t>& x) {
+        const auto count = std::min<std::size_t>(x.size(), 4096);
+        uint64_t cycles = 0;
+
+        auto call = [&](uint32_t fn, float a, float b) {
+            const auto r = cpu.call(fn, { std::bit_cast<uint32_t>(a), std::bit_cast<uint32_t>(b) });
+            cycles += cpu.cycles;
+            return std::bit_cast<float>(r);
+        };
+        for (std::size_t n = 0; n < count; n++) {
+            float s = float(x[n]);
+            for (std::size_t i = 0; i < N; i++) {
+                const auto& c = f.sos[i];
+                auto& w = f.w[i];
+                auto f6 = call(fadd, call(fadd, s, call(fmul, c.a1, w.w0)), call(fmul, c.a2, w.w1));
+                s = call(fadd, call(fadd, f6, call(fmul, c.b1, w.w0)), call(fmul, c.b2, w.w1));
+                w.w1 = std::exchange(w.w0, f6);
+            }
+        }
+        return double(cycles) / double(count * N);
+    }
+
+    void report(unsigned& shown, const char *filter, const char *signal, std::size_t n,
+                const char *what, sos_u got, sos_u want) {
+        mismatches++;
+        if (shown++ < 5) {
+            std::printf("  %s, %s, sample %zu: %s %08X:%d, model gives %08X:%d\n", filter, signal, n,
+                what, uint32_t(got.m), got.e, uint32_t(want.m), want.e);
+        }
+    }
+
+    void fault(const char *filter, const char *signal, std::size_t n) {
+        std::printf("  %s, %s, sample %zu: %s\n", filter, signal, n, cpu.fault.c_str());
+        faulted = true;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    double seconds = 0.5;
+    for (int opt; (opt = getopt(argc, argv, "s:")) != -1;) {
+        if (opt != 's') {
+            std::fprintf(stderr, "usage: %s [-s seconds] object...\n", argv[0]);
+            return 2;
+        }
+        seconds = std::atof(optarg);
+    }
+
+    Armv6m cpu;
+    for (int i = optind; i < argc; i++) {
+        if (!cpu.load(argv[i])) {
+            std::fprintf(stderr, "%s\n", cpu.fault.c_str());
+            return 2;
+        }
+    }
+
+    Check check { cpu, cpu.symbol("sos_u_cascade"), cpu.symbol("sos_u_sum_sqr"),
+                  cpu.symbol("qfp_fadd_asm"), cpu.symbol("qfp_fmul_asm") };
+    if (!check.cascade || !check.sum_sqr) {
+        std::fprintf(stderr, "sos_u_cascade and sos_u_sum_sqr not found in the given objects\n");
+        return 2;
+    }
+
+    const auto sigs = testSignals<int32_t>(std::size_t(seconds * SAMPLE_RATE) / BLOCK * BLOCK);
+    std::printf("%zu signals of %.2f s in blocks of %u, Cortex-M0+ cycles from RAM\n",
+        sigs.size(), seconds, BLOCK);
+    std::printf("%-10s %8s %12s %14s", "filter", "sections", "per sample", "per section");
+    if (check.fadd && check.fmul)
+        std::printf(" %14s %8s", "qfplib float", "speedup");
+    std::printf("\n");
+
+    const Totals t[] = {
+        check.run("equalizer", MIC_DESIGN, sigs),
+        check.run("A", A_DESIGN, sigs),
+        check.run("C", C_DESIGN, sigs),
+        check.run("Z", Z_DESIGN, sigs),
+    };
+
+    // As Leq_accumulate() runs them: each weighting also sums squares
+    double chain = 0;
+    for (const auto& x : t) {
+        if (x.samples > 0)
+            chain += double(x.cycles) / x.samples;
+    }
+    const double squares = double(t[1].sum_cycles) / t[1].sum_samples;
+    chain += 3 * squares;
+    std::printf("sum of squares: %.1f cycles per sample\n", squares);
+    std::printf("equalizer and A, C and Z weightings: %.1f cycles per filtered sample\n", chain);
+
+    const bool pass = !check.faulted && check.mismatches == 0;
+    std::printf("%u mismatches: %s\n", check.mismatches, pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
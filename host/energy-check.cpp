@@ -0,0 +1,108 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks the Energy accumulator of energy.h over a long integration. A
+// simulated day of block sums, one per callback period as Leq_accumulate()
+// produces them, follows a level that swings from about 35 to 85 dB over
+// the day, with a random 10 dB spread from second to second and block
+// energies that vary around it as noise does.
+//
+// The blocks are summed three ways: into one float, as Leq_sum_sqr was;
+// into one Energy; and into an Energy per second, rolled up into an Energy
+// per hour and those into one for the whole run. Each total, and each
+// hour's, is compared with a long double sum and printed as a level error.
+// Fails if either Energy total, or any hour, is off by more than max_dB
+// (default 0.0001).
+//
+// Usage: energy-check [-h hours] [max_dB]
+
+#include "energy.h"
+#include "leq.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+
+static double errorDB(double got, long double want)
+{
+    return 10 * std::log10(got / double(want));
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned hours = 24;
+    for (int opt; (opt = getopt(argc, argv, "h:")) != -1;) {
+        if (opt != 'h') {
+            std::fprintf(stderr, "usage: %s [-h hours] [max_dB]\n", argv[0]);
+            return 2;
+        }
+        hours = std::max(1, std::atoi(optarg));
+    }
+    const double max_dB = optind < argc ? std::atof(argv[optind]) : 0.0001;
+
+    const double ref = float(MIC_REF_AMPL) * float(MIC_REF_AMPL);
+    std::mt19937 rng (1);
+    std::normal_distribution<double> spread (0, 10 / 2.);
+    std::gamma_distribution<double> block (I2S_USESIZ / 2., 2. / I2S_USESIZ);
+
+    sos_t flat {};
+    Energy direct {}, total {};
+    long double want = 0;
+    double worst_hour = 0;
+    unsigned long blocks = 0;
+
+    for (unsigned h = 0; h < hours; h++) {
+        Energy hour {};
+        long double hour_want = 0;
+        for (unsigned s = 0; s < 3600; s++) {
+            const double t = (h * 3600. + s) / 86400;
+            const double level = 60 - 25 * std::cos(2 * M_PI * t) + spread(rng);
+            const double ms = ref * std::pow(10., (level - float(MIC_REF_DB)) / 20 * 2);
+
+            // The callback periods that end within this second
+            Energy second {};
+            for (; (blocks + 1) * I2S_FRAMES <= (h * 3600ul + s + 1) * SAMPLE_RATE; blocks++) {
+                const auto e = sos_t(float(ms * I2S_USESIZ * block(rng)));
+                flat += e;
+                direct += e;
+                second += e;
+                hour_want += float(e);
+            }
+            hour += second;
+        }
+        total += hour;
+        want += hour_want;
+        worst_hour = std::max(worst_hour, std::abs(errorDB(float(hour.value()), hour_want)));
+    }
+
+    const auto count = blocks * I2S_USESIZ;
+    std::printf("%u h, %lu blocks of %u samples, Leq %.2f dB\n", hours, blocks, I2S_USESIZ,
+        float(MIC_REF_DB) + 10 * std::log10(double(want) / count / ref));
+    const double e_flat = errorDB(float(flat), want);
+    const double e_direct = errorDB(float(direct.value()), want);
+    const double e_total = errorDB(float(total.value()), want);
+    std::printf("  float sum          %+.6f dB\n", e_flat);
+    std::printf("  Energy             %+.6f dB\n", e_direct);
+    std::printf("  Energy, rolled up  %+.6f dB (worst hour %.6f dB)\n", e_total, worst_hour);
+
+    const bool pass = std::abs(e_direct) <= max_dB && std::abs(e_total) <= max_dB &&
+        worst_hour <= max_dB;
+    std::printf("max error %g dB allowed: %s\n", max_dB, pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks the equalizer and the A, C and Z weightings as Leq_accumulate() runs
+// them, in both fixed-point and float forms, against a double-precision
+// reference, using tones and noise across the microphone's range.
+//
+// For each signal and weighting the reference Leq is printed, followed by the
+// float and fixed-point offsets from it and the level of the fixed-point
+// error signal (output minus reference). Fails if a fixed-point Leq is off by
+// more than the tolerance for any signal at least 10 dB above the
+// microphone's noise floor (closer than that, the mic's own noise dominates),
+// or if its error signal comes within 10 dB of that floor.
+//
+// Usage: fixed-check [tolerance_dB]
+
+#include "leqconfig.h"
+#include "reference.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <span>
+#include <vector>
+
+static constexpr const char *WEIGHTING_NAMES[] = { "A", "C", "Z" };
+
+// The whole equalizer without its gain, which the weightings' designs carry
+static constexpr auto EQ_DESIGN = SOS_IIR_Filter(sos_t(1.f), MIC_EQUALIZER.sos);
+
+static const double FULLSCALE = (1 << (MIC_BITS - 1)) - 1;
+static const double REF_AMPL  = FULLSCALE * std::pow(10., float(MIC_SENSITIVITY) / 20);
+
+static double todB(double sum_sqr, std::size_t count)
+{
+    return float(MIC_REF_DB) + 10 * std::log10(sum_sqr / count / (REF_AMPL * REF_AMPL));
+}
+
+// One weighting fed by the shared equalizer output: the double reference and
+// the float and fixed filters that leq.h builds from design F, with their sums
+template<const auto& F>
+struct Path {
+    Reference ref;
+    SOS_IIR_Filter<F.sos.size()> fwt = F;
+    SOS_IIR_Static<F, int32_t> qwt;
+    SOS_IIR_Static<F, int32_t> qtap;
+    double rsum = 0, fsum = 0, qsum = 0, qerr = 0;
+
+    Path(const auto& weighting) {
+        ref.append(weighting);
+    }
+};
+
+struct Result {
+    double ref_dB;
+    double float_dB;
+    double fixed_dB;
+    double fixed_err_dB;
+};
+
+static std::array<Result, 3> run(const std::vector<int32_t>& input)
+{
+    auto feq = sos_filter_cast<sos_t>(EQ_DESIGN);
+    SOS_IIR_Static<EQ_DESIGN, int32_t> qeq;
+    Reference req;
+    req.append(MIC_EQUALIZER);
+
+    Path<A_DESIGN> a (WEIGHTING_A);
+    Path<C_DESIGN> c (WEIGHTING_C);
+    Path<Z_DESIGN> z (WEIGHTING_Z);
+
+    // Skip the first half second so all paths have settled
+    const auto settle = SAMPLE_RATE / 2;
+    const double qscale = std::ldexp(1., -int(SAMPLE_SHIFT));
+    std::size_t count = 0;
+
+    for (std::size_t i = 0; i + I2S_USESIZ <= input.size(); i += I2S_USESIZ) {
+        std::array<sos_t, I2S_USESIZ> fs;
+        std::array<int32_t, I2S_USESIZ> qs;
+        std::array<double, I2S_USESIZ> rs;
+        for (unsigned j = 0; j < I2S_USESIZ; j++) {
+            fs[j] = sos_t(float(input[i + j]));
+            qs[j] = input[i + j] << SAMPLE_SHIFT;
+            rs[j] = req(input[i + j]) * req.gain;
+        }
+
+        // Same order as Leq_accumulate()
+        feq.filter(std::span(fs));
+        qeq.filter(std::span(qs));
+
+        auto weigh = [&](auto& p) {
+            const auto fss = p.fwt.sum_sqr_of(fs);
+            const auto qss = p.qwt.sum_sqr_of(qs);
+
+            // A second copy in lockstep gives the fixed-point output samples
+            auto qo = qs;
+            p.qtap.filter(std::span(qo));
+
+            std::array<double, I2S_USESIZ> ro;
+            for (unsigned j = 0; j < I2S_USESIZ; j++)
+                ro[j] = p.ref(rs[j]) * p.ref.gain;
+
+            if (i < settle)
+                return;
+            for (unsigned j = 0; j < I2S_USESIZ; j++) {
+                const double q = qo[j] * qscale * float(p.qtap.gain);
+                p.rsum += ro[j] * ro[j];
+                p.qerr += (q - ro[j]) * (q - ro[j]);
+            }
+            p.fsum += float(fss);
+            p.qsum += float(qss) * qscale * qscale;
+        };
+        weigh(a);
+        weigh(c);
+        weigh(z);
+
+        if (i >= settle)
+            count += I2S_USESIZ;
+    }
+
+    auto result = [&](const auto& p) {
+        return Result { todB(p.rsum, count), todB(p.fsum, count), todB(p.qsum, count),
+                        todB(p.qerr, count) };
+    };
+    return { result(a), result(c), result(z) };
+}
+
+int main(int argc, char *argv[])
+{
+    const double tolerance = argc > 1 ? std::atof(argv[1]) : 0.1;
+    const auto length = SAMPLE_RATE * 2;
+    bool pass = true;
+
+    std::printf("%10s %6s", "signal", "dBFS");
+    for (auto w : WEIGHTING_NAMES)
+        std::printf("   %s: %7s %7s %7s %6s", w, "ref", "float", "fixed", "err");
+    std::printf("\n");
+
+    auto report = [&](const char *name, double dBFS, const std::vector<int32_t>& x) {
+        std::printf("%10s %6.0f", name, dBFS);
+
+        bool bad = false;
+        for (const auto& r : run(x)) {
+            const auto diff = r.fixed_dB - r.ref_dB;
+            bad |= (r.ref_dB > float(MIC_NOISE_DB) + 10 && std::abs(diff) > tolerance) ||
+                r.fixed_err_dB > float(MIC_NOISE_DB) - 10;
+            std::printf("      %7.2f %+7.3f %+7.3f %6.1f", r.ref_dB, r.float_dB - r.ref_dB,
+                diff, r.fixed_err_dB);
+        }
+        pass &= !bad;
+        std::printf("%s\n", bad ? "  <--" : "");
+    };
+
+    for (double freq : { 31.5, 63., 125., 250., 500., 1000., 2000., 4000., 8000., 16000. }) {
+        char name[16];
+        std::snprintf(name, sizeof(name), "%.0fHz", freq);
+
+        for (double dBFS : { -3., -20., -40., -60., -80. }) {
+            const auto amp = FULLSCALE * std::pow(10., dBFS / 20);
+            std::vector<int32_t> x (length);
+            for (unsigned n = 0; n < length; n++)
+                x[n] = int32_t(std::lround(amp * std::sin(2 * M_PI * freq * n / SAMPLE_RATE)));
+            report(name, dBFS, x);
+        }
+    }
+
+    std::mt19937 rng (1);
+    for (double dBFS : { -10., -30., -50., -70., -90. }) {
+        std::normal_distribution<double> dist (0., FULLSCALE * std::pow(10., dBFS / 20));
+        std::vector<int32_t> x (length);
+        for (auto& s : x)
+            s = int32_t(std::clamp<long>(std::lround(dist(rng)), -FULLSCALE, FULLSCALE));
+        report("noise", dBFS, x);
+    }
+
+    std::printf("tolerance %.3f dB above %.0f dB: %s\n", tolerance, float(MIC_NOISE_DB) + 10,
+        pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
+
@@ -0,0 +1,51 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_I2S_H
+#define HOST_I2S_H
+
+// Builds DMA buffer contents as the I2S peripheral would write them, so host
+// tools exercise fixsample() along with the rest of the firmware path.
+
+#include "leq.h"
+
+#include <cstdint>
+#include <vector>
+
+// Inverse of fixsample(): truncate to the microphone's bits and swap half-words.
+template<typename M = Mic>
+inline uint32_t i2sPack(int32_t sample)
+{
+    const auto s = uint32_t(sample) & ~((1u << (32 - M::bits)) - 1);
+    return (s << 16) | (s >> 16);
+}
+
+// Interleaves left-justified samples into stereo frames in Mic::slot (the
+// other channel zero),
+// padded to a whole number of callback periods.
+inline std::vector<uint32_t> i2sFrames(const std::vector<int32_t>& samples)
+{
+    constexpr auto period = I2S_FRAMES * 2;
+    const auto words = (samples.size() * 2 + period - 1) / period * period;
+    std::vector<uint32_t> frames (words, 0);
+
+    for (size_t i = 0; i < samples.size(); i++)
+        frames[i * 2 + Mic::slot] = i2sPack(samples[i]);
+
+    return frames;
+}
+
+#endif // HOST_I2S_H
@@ -0,0 +1,404 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks the firmware's measurement chain against IEC 61672-1:2013 by
+// feeding synthetic signals through Leq_accumulate() as I2S DMA words:
+//
+// * frequency weighting: steady tones at the one-third-octave frequencies
+//   from 10 Hz to 20 kHz, at MIC_REF_DB, where the weighted reading should
+//   be at least 10 dB above the microphone's noise floor;
+// * level linearity: 31.5 Hz, 1 kHz and 8 kHz tones from just below overload
+//   down to where LAeq is 10 dB above the microphone's noise floor, against
+//   the reading at MIC_REF_DB;
+// * tone bursts: 4 kHz bursts from 1 s down to 0.25 ms, read as LAFmax and
+//   as sound exposure level (LAE), against a steady tone.
+//
+// The microphone is modelled as the inverse of its equalizer: each tone is
+// scaled by 1 / |EQ(f)| before it is quantized. This checks the weighting
+// filters and the arithmetic of the chain, not how well the equalizer fits
+// the microphone.
+//
+// Each result is held to the acceptance limits of Class 2 (or Class 1 with
+// -1). Each Leq is also compared with a double-precision model of the same
+// filters, and must agree to within the tolerance when the model reads at
+// least 10 dB above the noise floor and no more than MODEL_RANGE_DB below
+// the unweighted level. Lines failing either are marked, and the check
+// fails if there are any. The last column is the time taken by
+// Leq_accumulate() for the run, in ns per sample.
+//
+// Tone bursts need LEQ_FULL_COVERAGE, so that they land in filtered frames.
+// A windowed build (iec-check-windowed) checks the steady tones only, with
+// the model fed the same windows of each callback period as the chain. Its
+// frequency weighting is held to the model but not to the limits, which it
+// misses below about 1 kHz.
+//
+// Usage: iec-check [-1] [tolerance_dB]
+
+#include "leq.h"
+#include "i2s.h"
+#include "reference.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static constexpr unsigned HALFSIZE = I2S_FRAMES * 2; // Words per callback period
+static constexpr unsigned SETTLE_HALVES = i2sHalvesFor(500);
+static constexpr const char *WEIGHTING_NAMES[] = { "A", "C", "Z" };
+
+// The float filters' rounding error follows the input level, so it swamps
+// readings that a weighting has cut by more than this (below about 40 Hz
+// for A-weighting)
+static constexpr double MODEL_RANGE_DB = 30;
+
+static const double FULLSCALE = (1 << (MIC_BITS - 1)) - 1;
+static const double REF_AMPL  = FULLSCALE * std::pow(10., float(MIC_SENSITIVITY) / 20);
+
+// Acceptance limits in dB: deviation allowed above and below the goal, for
+// Class 1 and Class 2
+struct Limits {
+    double plus[2];
+    double minus[2];
+
+    bool accepts(double dev, unsigned cls) const {
+        return dev <= plus[cls - 1] && dev >= -minus[cls - 1];
+    }
+};
+
+static constexpr double INF = INFINITY;
+
+// IEC 61672-1:2013 Table 3, at the exact one-third-octave frequencies
+struct Weighting_point {
+    double freq;
+    Limits limits;
+};
+
+static const Weighting_point WEIGHTING_LIMITS[] = {
+    {    10, { { 3.0, 5.0 }, { INF, INF } } },
+    {  12.5, { { 2.5, 5.0 }, { INF, INF } } },
+    {    16, { { 2.0, 5.0 }, { 4.0, INF } } },
+    {    20, { { 2.0, 3.0 }, { 2.0, 3.0 } } },
+    {    25, { { 2.0, 3.0 }, { 1.5, 3.0 } } },
+    {  31.5, { { 1.5, 3.0 }, { 1.5, 3.0 } } },
+    {    40, { { 1.0, 2.0 }, { 1.0, 2.0 } } },
+    {    50, { { 1.0, 2.0 }, { 1.0, 2.0 } } },
+    {    63, { { 1.0, 2.0 }, { 1.0, 2.0 } } },
+    {    80, { { 1.0, 2.0 }, { 1.0, 2.0 } } },
+    {   100, { { 1.0, 1.5 }, { 1.0, 1.5 } } },
+    {   125, { { 1.0, 1.5 }, { 1.0, 1.5 } } },
+    {   160, { { 1.0, 1.5 }, { 1.0, 1.5 } } },
+    {   200, { { 1.0, 1.5 }, { 1.0, 1.5 } } },
+    {   250, { { 1.0, 1.5 }, { 1.0, 1.5 } } },
+    {   315, { { 1.0, 1.5 }, { 1.0, 1.5 } } },
+    {   400, { { 1.0, 1.5 }, { 1.0, 1.5 } } },
+    {   500, { { 1.0, 1.5 }, { 1.0, 1.5 } } },
+    {   630, { { 1.0, 1.5 }, { 1.0, 1.5 } } },
+    {   800, { { 1.0, 1.5 }, { 1.0, 1.5 } } },
+    {  1000, { { 0.7, 1.0 }, { 0.7, 1.0 } } },
+    {  1250, { { 1.0, 1.5 }, { 1.0, 1.5 } } },
+    {  1600, { { 1.0, 2.0 }, { 1.0, 2.0 } } },
+    {  2000, { { 1.0, 2.0 }, { 1.0, 2.0 } } },
+    {  2500, { { 1.0, 2.5 }, { 1.0, 2.5 } } },
+    {  3150, { { 1.0, 2.5 }, { 1.0, 2.5 } } },
+    {  4000, { { 1.0, 3.0 }, { 1.0, 3.0 } } },
+    {  5000, { { 1.5, 3.5 }, { 1.5, 3.5 } } },
+    {  6300, { { 1.5, 4.5 }, { 2.0, 4.5 } } },
+    {  8000, { { 1.5, 5.0 }, { 2.5, 5.0 } } },
+    { 10000, { { 2.0, 5.0 }, { 3.0, INF } } },
+    { 12500, { { 2.0, 5.0 }, { 5.0, INF } } },
+    { 16000, { { 2.5, 5.0 }, { 16., INF } } },
+    { 20000, { { 3.0, 5.0 }, { INF, INF } } },
+};
+
+// IEC 61672-1:2013 5.6.5
+static const Limits LINEARITY_LIMITS = { { 0.8, 1.1 }, { 0.8, 1.1 } };
+
+// IEC 61672-1:2013 Table 4, for both LAFmax and LAE
+struct Burst_point {
+    double ms;
+    Limits limits;
+};
+
+static const Burst_point BURST_LIMITS[] = {
+    { 1000, { { 0.5, 1.0 }, { 0.5, 1.0 } } },
+    {  500, { { 0.5, 1.0 }, { 0.5, 1.0 } } },
+    {  200, { { 0.5, 1.0 }, { 0.5, 1.0 } } },
+    {  100, { { 1.0, 1.0 }, { 1.0, 1.0 } } },
+    {   50, { { 1.0, 1.0 }, { 1.5, 2.5 } } },
+    {   20, { { 1.0, 1.0 }, { 1.5, 2.5 } } },
+    {   10, { { 1.0, 1.0 }, { 1.5, 2.5 } } },
+    {    5, { { 1.0, 1.0 }, { 1.5, 2.5 } } },
+    {    2, { { 1.0, 1.0 }, { 1.5, 2.5 } } },
+    {    1, { { 1.0, 1.0 }, { 2.0, 3.0 } } },
+    {  0.5, { { 1.0, 1.0 }, { 2.5, 4.0 } } },
+    { 0.25, { { 1.0, 1.5 }, { 3.0, 5.0 } } },
+};
+
+// Nominal frequency weighting in dB, from the analog prototype of
+// IEC 61672-1 Annex E, normalized at 1 kHz
+static double weighting_dB(unsigned w, double f)
+{
+    auto response = [w](double f) {
+        constexpr double f1 = 20.598997, f2 = 107.65265, f3 = 737.86223, f4 = 12194.217;
+        const double ff = f * f;
+        const double c = f4 * f4 * ff / ((ff + f1 * f1) * (ff + f4 * f4));
+        if (w == LEQ_C)
+            return 20 * std::log10(c);
+        if (w == LEQ_A)
+            return 20 * std::log10(c * ff / std::sqrt((ff + f2 * f2) * (ff + f3 * f3)));
+        return 0.;
+    };
+    return response(f) - response(1000);
+}
+
+// Peak, in steps of the microphone's output, of a tone of `level` dB at
+// `freq` Hz
+static double tonePeak(double freq, double level)
+{
+    const double eq = sos_magnitude(MIC_EQUALIZER, freq, SAMPLE_RATE);
+    return std::sqrt(2.) * REF_AMPL * std::pow(10., (level - float(MIC_REF_DB)) / 20) / eq;
+}
+
+// Left-justified samples of a tone at `level` dB and `freq` Hz, as the
+// microphone would deliver them: `seconds` long, silent outside of
+// [start, start + length) seconds, in whole callback periods.
+static std::vector<int32_t> tone(double freq, double level, double seconds,
+    double start = 0, double length = INF)
+{
+    const auto peak = tonePeak(freq, level);
+    const auto n0 = std::lround(start * SAMPLE_RATE);
+    const auto n1 = length == INF ? LONG_MAX : n0 + std::lround(length * SAMPLE_RATE);
+    const auto count = (std::lround(seconds * SAMPLE_RATE) + I2S_FRAMES - 1) / I2S_FRAMES * I2S_FRAMES;
+
+    std::vector<int32_t> x (count, 0);
+    for (long n = n0; n < std::min(n1, long(count)); n++) {
+        const auto s = std::lround(peak * std::sin(2 * M_PI * freq * (n - n0) / SAMPLE_RATE));
+        x[n] = int32_t(std::clamp<long>(s, -FULLSCALE, FULLSCALE) << (32 - MIC_BITS));
+    }
+    return x;
+}
+
+struct Reading {
+    std::array<double, LEQ_WEIGHTINGS> dB;      // From Leq_accumulate()
+    std::array<double, LEQ_WEIGHTINGS> ref_dB;  // From the double-precision model
+    double fmax_dB;   // LAFmax
+    double seconds;   // Length of the measurement
+    double ns;        // Leq_accumulate() time per sample
+};
+
+// Runs `x` through Leq_accumulate() from power-up and through the
+// double-precision model. Readings start after SETTLE_HALVES.
+static Reading measure(const std::vector<int32_t>& x)
+{
+    Leq_input = {};
+    for (auto& w : MIC_FILTER.w) w = {};
+    for (auto& w : A_FILTER.w) w = {};
+    for (auto& w : C_FILTER.w) w = {};
+    for (auto& w : Z_FILTER.w) w = {};
+    Leq_sum_sqr = {};
+    Leq_samples = 0;
+    Leq_fast = {};
+    Leq_fast_max = {};
+
+    auto frames = i2sFrames(x);
+    const auto halves = frames.size() / HALFSIZE;
+    Reading r;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t h = 0; h < halves; h++) {
+        if (h == SETTLE_HALVES) {
+            Leq_sum_sqr = {};
+            Leq_samples = 0;
+            Leq_fast_max = {};
+        }
+        Leq_accumulate(frames.data() + h * HALFSIZE);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    r.ns = std::chrono::duration<double, std::nano>(end - start).count() / (halves * I2S_USESIZ);
+
+    for (unsigned i = 0; i < LEQ_WEIGHTINGS; i++)
+        r.dB[i] = float(Leq_to_dB(Leq_sum_sqr[i], Leq_samples));
+    r.fmax_dB = float(Leq_to_dB(Leq_fast_max, I2S_USESIZ));
+    r.seconds = double(Leq_samples) / SAMPLE_RATE;
+
+    std::array<Reference, LEQ_WEIGHTINGS> ref;
+    for (auto& m : ref)
+        m.append(MIC_EQUALIZER);
+    ref[LEQ_A].append(WEIGHTING_A);
+    ref[LEQ_C].append(WEIGHTING_C);
+    ref[LEQ_Z].append(WEIGHTING_Z);
+
+    std::array<double, LEQ_WEIGHTINGS> sum {};
+    std::size_t count = 0;
+    const auto settle = SETTLE_HALVES * I2S_FRAMES;
+    for (size_t n = 0; n < x.size(); n++) {
+        // Only the frames that Leq_accumulate() filters, one window after another
+        if (n % I2S_FRAMES >= I2S_USESIZ)
+            continue;
+        const double s = x[n] >> (32 - MIC_BITS);
+        for (unsigned i = 0; i < LEQ_WEIGHTINGS; i++) {
+            const auto y = ref[i](s) * ref[i].gain;
+            if (n >= settle)
+                sum[i] += y * y;
+        }
+        count += n >= settle;
+    }
+    for (unsigned i = 0; i < LEQ_WEIGHTINGS; i++) {
+        r.ref_dB[i] = float(MIC_REF_DB) +
+            10 * std::log10(sum[i] / count / (REF_AMPL * REF_AMPL));
+    }
+
+    return r;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned cls = 2;
+    double tolerance = 0.01;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "-1")
+            cls = 1;
+        else
+            tolerance = std::atof(argv[i]);
+    }
+
+    const double floor = float(MIC_NOISE_DB) + 10;
+    unsigned failures = 0;
+    unsigned outside = 0;   // Frequencies outside the limits, in a windowed build
+    double total_ns = 0;
+    unsigned runs = 0;
+
+    // True if each Leq in range agrees with the model
+    auto matches = [&](const Reading& r) {
+        total_ns += r.ns;
+        runs++;
+        for (unsigned i = 0; i < LEQ_WEIGHTINGS; i++) {
+            if (r.ref_dB[i] > floor && r.ref_dB[i] > r.ref_dB[LEQ_Z] - MODEL_RANGE_DB &&
+                std::abs(r.dB[i] - r.ref_dB[i]) > tolerance)
+                return false;
+        }
+        return true;
+    };
+    auto mark = [&](bool ok) {
+        failures += !ok;
+        std::printf("%s\n", ok ? "" : "  <--");
+    };
+
+    std::printf("Class %u, model tolerance %.3f dB above %.0f dB\n\n", cls, tolerance, floor);
+
+    // Frequency weighting at the reference level
+    std::printf("frequency weighting at %.0f dB: deviation from goal, limits, model offset\n",
+        float(MIC_REF_DB));
+    std::printf("%8s", "Hz");
+    for (auto w : WEIGHTING_NAMES)
+        std::printf("   %s: %7s %6s %6s %7s", w, "dev", "+lim", "-lim", "model");
+    std::printf(" %8s\n", "ns/smp");
+    for (const auto& p : WEIGHTING_LIMITS) {
+        // Exact base-ten frequency for each nominal one
+        const double freq = 1000 * std::pow(10., std::round(10 * std::log10(p.freq / 1000)) / 10);
+        const auto r = measure(tone(freq, float(MIC_REF_DB), 2.5));
+
+        bool within = true;
+        std::printf("%8.1f", p.freq);
+        for (unsigned i = 0; i < LEQ_WEIGHTINGS; i++) {
+            // Readings below the floor are outside the linear operating range
+            const auto goal = weighting_dB(i, freq);
+            const auto dev = r.dB[i] - float(MIC_REF_DB) - goal;
+            within &= float(MIC_REF_DB) + goal < floor || p.limits.accepts(dev, cls);
+            std::printf("      %+7.3f %6.1f %6.1f %+7.3f", dev, p.limits.plus[cls - 1],
+                -p.limits.minus[cls - 1], r.dB[i] - r.ref_dB[i]);
+        }
+        std::printf(" %8.2f", r.ns);
+
+        // Filtering the windows back to back splices the tone, which spreads
+        // low tones over every band, so a windowed build is held to the
+        // model alone and its misses are only counted
+        if (I2S_GEOMETRY.windowed()) {
+            outside += !within;
+            std::printf("%s", within ? "" : "  x");
+            mark(matches(r));
+        } else {
+            mark(matches(r) && within);
+        }
+    }
+
+    // Level linearity, relative to the reading at the reference level
+    std::printf("\nlevel linearity: error from reading at %.0f dB, limit +/-%.1f\n",
+        float(MIC_REF_DB), LINEARITY_LIMITS.plus[cls - 1]);
+    std::printf("%8s %6s   %s: %7s %7s %8s\n", "Hz", "dB", "A", "error", "model", "ns/smp");
+    for (double freq : { 31.5, 1000., 8000. }) {
+        const auto ref = measure(tone(freq, float(MIC_REF_DB), 2.5));
+        matches(ref);
+
+        // From below overload or clipping down to where the A-weighted
+        // reading meets the floor, in 1 dB steps within 5 dB of either end
+        // and 5 dB steps between
+        const int top = int(std::floor(std::min<double>(MIC_OVERLOAD_DB, float(MIC_REF_DB) +
+            20 * std::log10(FULLSCALE / tonePeak(freq, float(MIC_REF_DB)))))) - 1;
+        const int bottom = int(std::ceil(floor - weighting_dB(LEQ_A, freq)));
+        for (int level = top; level >= bottom;
+             level -= (level > top - 5 || level <= bottom + 5) ? 1 : 5) {
+            const auto r = measure(tone(freq, level, 2.5));
+            const auto err = (r.dB[LEQ_A] - ref.dB[LEQ_A]) - (level - float(MIC_REF_DB));
+            const bool ok = matches(r) && LINEARITY_LIMITS.accepts(err, cls);
+            std::printf("%8.1f %6d      %+7.3f %+7.3f %8.2f", freq, level, err,
+                r.dB[LEQ_A] - r.ref_dB[LEQ_A], r.ns);
+            mark(ok);
+        }
+    }
+
+    if (I2S_GEOMETRY.windowed()) {
+        std::printf("\n%u of %zu frequencies (x) outside the Class %u limits, not held with "
+            "%u of %u frames filtered per period; tone bursts not checked\n", outside,
+            std::size(WEIGHTING_LIMITS), cls, I2S_USESIZ, I2S_FRAMES);
+        std::printf("\n%u runs, %.2f ns/sample mean: %s\n", runs, total_ns / runs,
+            failures == 0 ? "PASS" : "FAIL");
+        return failures == 0 ? 0 : 1;
+    }
+
+    // Tone bursts, against a steady tone at the same level
+    constexpr double burst_freq = 4000;
+    const double burst_level = float(MIC_REF_DB) + 16;
+    const auto steady = measure(tone(burst_freq, burst_level, 2.5));
+    matches(steady);
+    std::printf("\n%.0f Hz tone bursts at %.0f dB: deviation from reference response, limits\n",
+        burst_freq, burst_level);
+    std::printf("%8s %8s  LAFmax: %7s   LAE: %7s %6s %6s %8s\n", "ms", "ref", "dev", "dev",
+        "+lim", "-lim", "ns/smp");
+    for (const auto& p : BURST_LIMITS) {
+        // Starts on a zero crossing a quarter second after settling
+        const auto r = measure(tone(burst_freq, burst_level, 2.5, 0.75, p.ms / 1000));
+        const double fast = 10 * std::log10(1 - std::exp(-p.ms / 1000 / 0.125));
+        const double exposure = 10 * std::log10(p.ms / 1000);
+        const auto lafmax = r.fmax_dB - steady.dB[LEQ_A] - fast;
+        const auto lae = r.dB[LEQ_A] + 10 * std::log10(r.seconds) - steady.dB[LEQ_A] - exposure;
+        const bool ok = matches(r) && p.limits.accepts(lafmax, cls) && p.limits.accepts(lae, cls);
+        std::printf("%8.2f %+8.1f          %+7.3f        %+7.3f %6.1f %6.1f %8.2f", p.ms, fast,
+            lafmax, lae, p.limits.plus[cls - 1], -p.limits.minus[cls - 1], r.ns);
+        mark(ok);
+    }
+
+    std::printf("\n%u runs, %.2f ns/sample mean: %s\n", runs, total_ns / runs,
+        failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
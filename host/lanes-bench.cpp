@@ -0,0 +1,156 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Compares the multi-channel filter kernel of sos-lanes.h with the scalar
+// SOS_IIR_Filter path. Each channel is a different noise signal run through
+// leq.h's equalizer and A, C and Z weightings, one callback period at a
+// time, as Leq_accumulate() would. Prints channel-samples/sec for the
+// scalar path and for each instruction set the host supports, with 8 and
+// 16 channels, and fails if any channel's sums differ from the scalar path.
+//
+// Usage: lanes-bench [-s seconds]
+
+#include "leq.h"
+#include "sos-lanes.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <unistd.h>
+
+static_assert(std::is_same_v<sample_t, sos_t>, "the lanes kernel is float only");
+
+static constexpr unsigned BLOCK = I2S_FRAMES;
+
+struct Sums {
+    std::vector<std::array<float, LEQ_WEIGHTINGS>> channels;
+    double seconds;
+};
+
+// Channel c of frame t is at [t * channels + c]
+static std::vector<float> noise(unsigned channels, std::size_t frames)
+{
+    std::mt19937 rng (1);
+    std::normal_distribution<float> dist (0.f, float(1 << 20));
+    std::vector<float> x (channels * frames);
+    for (auto& s : x)
+        s = float(int32_t(dist(rng)) >> 8 << 8);
+    return x;
+}
+
+static Sums runScalar(const std::vector<float>& x, unsigned channels, std::size_t frames)
+{
+    Sums out { std::vector<std::array<float, LEQ_WEIGHTINGS>>(channels), 0 };
+    const auto start = std::chrono::steady_clock::now();
+
+    for (unsigned c = 0; c < channels; c++) {
+        auto eq = MIC_FILTER;
+        auto a = A_FILTER;
+        auto cw = C_FILTER;
+        auto z = Z_FILTER;
+        std::array<sos_t, LEQ_WEIGHTINGS> sums {};
+
+        for (std::size_t t = 0; t + BLOCK <= frames; t += BLOCK) {
+            std::array<sos_t, BLOCK> block;
+            for (unsigned i = 0; i < BLOCK; i++)
+                block[i] = x[(t + i) * channels + c];
+            eq.filter(std::span(block));
+            sums[LEQ_A] += a.sum_sqr_of(block);
+            sums[LEQ_C] += cw.sum_sqr_of(block);
+            sums[LEQ_Z] += z.sum_sqr_of(block);
+        }
+        for (unsigned w = 0; w < LEQ_WEIGHTINGS; w++)
+            out.channels[c][w] = float(sums[w]);
+    }
+
+    out.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return out;
+}
+
+template<unsigned L>
+static Sums runLanes(const std::vector<float>& x, std::size_t frames, Lanes_isa isa)
+{
+    Sums out { std::vector<std::array<float, LEQ_WEIGHTINGS>>(L), 0 };
+    const auto start = std::chrono::steady_clock::now();
+
+    SOS_IIR_Lanes<MIC_DESIGN.sos.size(), L> eq (MIC_DESIGN, isa);
+    SOS_IIR_Lanes<A_DESIGN.sos.size(), L> a (A_DESIGN, isa);
+    SOS_IIR_Lanes<C_DESIGN.sos.size(), L> c (C_DESIGN, isa);
+    SOS_IIR_Lanes<Z_DESIGN.sos.size(), L> z (Z_DESIGN, isa);
+    float sums[LEQ_WEIGHTINGS][L] {};
+    std::vector<float> block (BLOCK * L);
+
+    for (std::size_t t = 0; t + BLOCK <= frames; t += BLOCK) {
+        std::copy_n(x.begin() + t * L, BLOCK * L, block.begin());
+        eq.filter(block.data(), BLOCK);
+        a.sum_sqr_of(block.data(), BLOCK, sums[LEQ_A]);
+        c.sum_sqr_of(block.data(), BLOCK, sums[LEQ_C]);
+        z.sum_sqr_of(block.data(), BLOCK, sums[LEQ_Z]);
+    }
+    for (unsigned ch = 0; ch < L; ch++) {
+        for (unsigned w = 0; w < LEQ_WEIGHTINGS; w++)
+            out.channels[ch][w] = sums[w][ch];
+    }
+
+    out.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return out;
+}
+
+template<unsigned L>
+static bool bench(std::size_t frames)
+{
+    const auto x = noise(L, frames);
+    const auto scalar = runScalar(x, L, frames);
+    const double samples = double(L) * (frames / BLOCK * BLOCK);
+    bool pass = true;
+
+    std::printf("%2u channels  %-12s %8.2f M/s\n", L, "SOS_IIR_Filter", samples / scalar.seconds / 1e6);
+    for (auto isa : { Lanes_isa::scalar, Lanes_isa::sse, Lanes_isa::avx2 }) {
+        if (!lanes_supported(isa))
+            continue;
+        const auto r = runLanes<L>(x, frames, isa);
+        const bool same = r.channels == scalar.channels;
+        pass &= same;
+        std::printf("%2u channels  lanes %-6s %8.2f M/s  %5.2fx  %s\n", L, lanes_isa_name(isa),
+            samples / r.seconds / 1e6, scalar.seconds / r.seconds, same ? "same sums" : "DIFFERENT");
+    }
+    return pass;
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = 10;
+    for (int opt; (opt = getopt(argc, argv, "s:")) != -1;) {
+        if (opt != 's') {
+            std::fprintf(stderr, "usage: %s [-s seconds]\n", argv[0]);
+            return 1;
+        }
+        seconds = std::atof(optarg);
+    }
+
+    const auto frames = std::size_t(seconds * SAMPLE_RATE);
+    std::printf("%.0f s of audio per channel, channel-samples per second through the "
+        "equalizer and A, C and Z weightings\n", seconds);
+    const bool pass = bench<8>(frames) & bench<16>(frames);
+    std::printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Asks a card built with LEQ_CAPTURE for blocks of samples from one point in
+// its filter chain, and writes them to a WAV file scaled so that 1.0 is the
+// microphone's full scale. Taps are raw (microphone samples, before the DC
+// blocker), eq (after the equalizer), and a, c or z (after a weighting).
+//
+// Blocks are written back to back. A block is only contiguous audio with
+// LEQ_FULL_COVERAGE and `-e 1`; otherwise each holds the part of a callback
+// period that was filtered. Blocks the card had to drop are reported, and
+// left out.
+//
+// Usage: linkcapture [-b baud] [-t tap] [-n blocks] [-e every] port|capture out.wav
+
+#include "serial.h"
+#include "wav.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static constexpr std::array<const char *, LINK_TAPS> TAP_NAMES = { "raw", "eq", "a", "c", "z" };
+
+int main(int argc, char *argv[])
+{
+    std::string path, out;
+    unsigned baud = LINK_CAPTURE_BAUD;
+    Link_capture_request request { LINK_TAP_RAW, 1, 200 };
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg (argv[i]);
+        if (arg == "-b" && i + 1 < argc) {
+            baud = std::stoul(argv[++i]);
+        } else if (arg == "-n" && i + 1 < argc) {
+            request.blocks = uint16_t(std::clamp(std::stoul(argv[++i]), 1ul, 65535ul));
+        } else if (arg == "-e" && i + 1 < argc) {
+            request.every = uint8_t(std::clamp(std::stoul(argv[++i]), 1ul, 255ul));
+        } else if (arg == "-t" && i + 1 < argc) {
+            const std::string name (argv[++i]);
+            const auto t = std::ranges::find(TAP_NAMES, name) - TAP_NAMES.begin();
+            if (t == LINK_TAPS) {
+                std::fprintf(stderr, "unknown tap %s: use raw, eq, a, c or z\n", name.c_str());
+                return 1;
+            }
+            request.tap = uint8_t(t);
+        } else if (path.empty()) {
+            path = arg;
+        } else {
+            out = arg;
+        }
+    }
+
+    if (path.empty() || out.empty()) {
+        std::fprintf(stderr, "usage: %s [-b baud] [-t raw|eq|a|c|z] [-n blocks] [-e every] "
+            "port|capture out.wav\n", argv[0]);
+        return 1;
+    }
+
+    Serial serial;
+    if (!serialOpen(path, baud, serial))
+        return 1;
+    serialSend(serial, LINK_CAPTURE_REQUEST,
+               { reinterpret_cast<const uint8_t *>(&request), sizeof(request) });
+
+    static Link_parser<65535> parser;
+    std::vector<float> samples;
+    unsigned rate = 0, blocks = 0, gaps = 0;
+    uint32_t next = 0;
+
+    uint8_t buf[256];
+    ssize_t n;
+    while (blocks < request.blocks && (n = read(serial.fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n && blocks < request.blocks; i++) {
+            if (!parser.feed(buf[i]) || parser.type() != LINK_CAPTURE)
+                continue;
+
+            const auto payload = parser.payload();
+            Link_capture info;
+            if (payload.size() < sizeof(info))
+                continue;
+            std::memcpy(&info, payload.data(), sizeof(info));
+            if (payload.size() != sizeof(info) + info.count * sizeof(uint32_t) ||
+                info.tap != request.tap)
+                continue;
+
+            if (info.block != next)
+                gaps++;
+            next = info.block + request.every;
+            rate = info.rate;
+            blocks++;
+
+            for (unsigned j = 0; j < info.count; j++) {
+                uint32_t u;
+                std::memcpy(&u, payload.data() + sizeof(info) + j * sizeof(u), sizeof(u));
+                float f;
+                if (info.format == LINK_PCM_FLOAT32)
+                    std::memcpy(&f, &u, sizeof(f));
+                else
+                    f = float(int32_t(u));
+                samples.push_back(f * info.scale);
+            }
+        }
+    }
+
+    // Stop the card in case this ended early
+    const Link_capture_request stop { request.tap, 1, 0 };
+    serialSend(serial, LINK_CAPTURE_REQUEST,
+               { reinterpret_cast<const uint8_t *>(&stop), sizeof(stop) });
+
+    if (blocks == 0) {
+        std::fprintf(stderr, "%s: no capture blocks\n", path.c_str());
+        return 1;
+    }
+    if (!wavWrite(out, rate, samples)) {
+        std::fprintf(stderr, "%s: cannot write\n", out.c_str());
+        return 1;
+    }
+
+    std::fprintf(stderr, "%s: %u blocks of %s, %zu samples at %u Hz, %u gaps, %u bad frames\n",
+        out.c_str(), blocks, TAP_NAMES[request.tap], samples.size(), rate, gaps, parser.errors);
+    return 0;
+}
+
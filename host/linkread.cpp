@@ -0,0 +1,96 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Reads the card's data link (linkframe.h) from a serial port, or from a
+// capture of one, and prints each reading as CSV: reading number, then LAeq,
+// LCeq, LZeq and LAFmax in dB. With -d, asks the card for its flash log,
+// writes it to the given file for logdump, and exits once it arrives.
+//
+// Usage: linkread [-b baud] [-d log.bin] /dev/ttyUSB0|capture.bin
+
+#include "serial.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+int main(int argc, char *argv[])
+{
+    std::string path, dump;
+    unsigned baud = LINK_BAUD;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg (argv[i]);
+        if (arg == "-d" && i + 1 < argc)
+            dump = argv[++i];
+        else if (arg == "-b" && i + 1 < argc)
+            baud = std::stoul(argv[++i]);
+        else
+            path = arg;
+    }
+
+    if (path.empty()) {
+        std::fprintf(stderr, "usage: %s [-b baud] [-d log.bin] port|capture\n", argv[0]);
+        return 1;
+    }
+
+    Serial serial;
+    if (!serialOpen(path, baud, serial))
+        return 1;
+
+    // A request can be missed while a duty-cycled card is stopped, so it
+    // is repeated with each reading until the log arrives
+    if (!dump.empty())
+        serialSend(serial, LINK_DUMP_REQUEST);
+
+    static Link_parser<65535> parser;
+    std::printf("reading,LAeq,LCeq,LZeq,LAFmax\n");
+
+    uint8_t buf[256];
+    ssize_t n;
+    while ((n = read(serial.fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            if (!parser.feed(buf[i]))
+                continue;
+
+            const auto payload = parser.payload();
+            if (parser.type() == LINK_LEVELS && payload.size() == sizeof(Link_levels)) {
+                Link_levels l;
+                std::memcpy(&l, payload.data(), sizeof(l));
+                std::printf("%u,%.2f,%.2f,%.2f,%.2f\n", l.reading, l.laeq / 100.,
+                    l.lceq / 100., l.lzeq / 100., l.lafmax / 100.);
+                std::fflush(stdout);
+                if (!dump.empty())
+                    serialSend(serial, LINK_DUMP_REQUEST);
+            } else if (parser.type() == LINK_LOG && !dump.empty()) {
+                auto out = std::fopen(dump.c_str(), "wb");
+                if (!out || std::fwrite(payload.data(), 1, payload.size(), out) != payload.size()) {
+                    std::fprintf(stderr, "%s: cannot write\n", dump.c_str());
+                    return 1;
+                }
+                std::fclose(out);
+                std::fprintf(stderr, "%s: %zu bytes of log\n", dump.c_str(), payload.size());
+                return 0;
+            }
+        }
+    }
+
+    if (parser.errors > 0)
+        std::fprintf(stderr, "%s: %u bad frames\n", path.c_str(), parser.errors);
+    return 0;
+}
+
@@ -0,0 +1,327 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks that the log encoder (logcodec.h) and the host decoder
+// (logdecode.h) agree.
+//
+// First each block size from one reading to a full block is encoded and
+// decoded on its own, for random walks, jumps large enough to need the
+// escape, levels clamped at both ends of the range, and steady levels, with
+// three levels per reading and with LAeq alone (LEQ_LOG_LAEQ). The payload
+// must have the size logPlan() gave and decode to the same readings, and
+// with its last double word cut off it must be rejected.
+//
+// Then a model of logger.cpp writes blocks of such readings to an 8 KB
+// fake flash ring until it has wrapped many times, losing power now and
+// then partway through a double word, an erase or a block. After each
+// loss the writer resumes as logInit() does. logDecodeRegion() must give
+// back exactly the readings of every block whose trailer was written and
+// whose page has not since been erased, and must skip words only when
+// power was lost.
+//
+// Usage: log-check [-r runs]
+
+#include "logdecode.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+static constexpr unsigned LOG_PAGES = 8192 / FLASH_PAGE_BYTES;  // As in STM32G031x6.ld
+
+enum class Signal { Walk, Jumps, Clamped, Steady, Count };
+
+static const char *signalName(Signal s)
+{
+    switch (s) {
+    case Signal::Walk:    return "random walk";
+    case Signal::Jumps:   return "escape-sized jumps";
+    case Signal::Clamped: return "clamped levels";
+    default:              return "steady";
+    }
+}
+
+// `count` readings of `channels` levels each, one reading after another
+static std::vector<uint16_t> makeBlock(Signal s, unsigned count, unsigned channels,
+                                       std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> level (300, 1000), walk (-4, 4),
+        jump (-int(LOG_LEVEL_MAX), int(LOG_LEVEL_MAX)), side (0, 1);
+    std::vector<uint16_t> out (count * channels);
+    std::vector<uint16_t> last (channels);
+    for (auto& l : last)
+        l = uint16_t(level(rng));
+
+    for (unsigned i = 0; i < out.size(); i++) {
+        const auto c = i % channels;
+        switch (s) {
+        case Signal::Walk:
+            out[i] = logQuantize(last[c] + walk(rng));
+            break;
+        case Signal::Jumps:
+            out[i] = logQuantize(last[c] + jump(rng));
+            break;
+        case Signal::Clamped:
+            // Out of range on either side, as a reading could be
+            out[i] = logQuantize(side(rng) ? LOG_LEVEL_MAX + 1 + walk(rng) * 100
+                                           : -1 - walk(rng) * 100);
+            break;
+        default:
+            out[i] = last[c];
+            break;
+        }
+        last[c] = out[i];
+    }
+    return out;
+}
+
+// Encodes and decodes one block; returns false on any disagreement
+static bool roundTrip(std::span<const uint16_t> in, unsigned channels)
+{
+    const auto plan = logPlan(in, channels);
+    std::vector<uint64_t> words;
+    logEncode(in, plan, [&words](uint64_t w) { words.push_back(w); });
+    if (words.size() != plan.words() ||
+        plan.words() > logMaxWords(in.size() / channels, channels))
+        return false;
+
+    std::vector<uint16_t> out (in.size());
+    if (!logDecode(words, out, channels) || !std::ranges::equal(in, out))
+        return false;
+
+    // A payload short of a double word runs out of bits
+    return !logDecode(std::span(words).first(words.size() - 1), out, channels);
+}
+
+// logger.cpp's writer on a fake flash that power can fail under
+class Flash_log {
+public:
+    std::vector<uint64_t> flash = std::vector<uint64_t>(LOG_PAGES * LOG_PAGE_SLOTS, FLASH_ERASED);
+
+    // Readings of each block whose trailer was written, with its page
+    struct Block {
+        unsigned page;
+        uint32_t sequence;
+        std::vector<uint16_t> levels;
+    };
+    std::vector<Block> written;
+    unsigned losses = 0;
+
+    // Power fails on average once in `mean_words` steps, or never if zero
+    Flash_log(std::mt19937& r, unsigned mean_words, unsigned channels):
+        rng(r), loss(mean_words ? 1. / mean_words : 0), channels(channels) {
+        init();
+    }
+
+    // Writes one block; returns false if power was lost meanwhile
+    bool append(std::span<const uint16_t> block) {
+        if (session.flags & LOG_POWER_UP) {
+            if (!reserve(2))
+                return false;
+            if ((session.flags & LOG_POWER_UP) && !writeSession())
+                return false;
+        }
+
+        const auto plan = logPlan(block, channels);
+        if (!reserve(plan.words() + 1))
+            return false;
+
+        std::vector<uint64_t> words;
+        logEncode(block, plan, [&words](uint64_t w) { words.push_back(w); });
+        uint16_t crc = 0xFFFF;
+        for (auto w : words) {
+            crc = logCrc(w, crc);
+            if (!write(w))
+                return false;
+        }
+        const auto count = block.size() / channels;
+        if (!write(std::bit_cast<uint64_t>(Log_trailer::make(count, plan.words(), crc))))
+            return false;
+
+        written.push_back({ page, sequence, { block.begin(), block.end() } });
+        return true;
+    }
+
+    // What should decode: blocks on pages not erased since
+    std::vector<uint16_t> expected() const {
+        std::vector<uint16_t> out;
+        for (const auto& b : written) {
+            const auto h = std::bit_cast<Log_page_header>(flash[b.page * LOG_PAGE_SLOTS]);
+            if (h.magic == LOG_MAGIC && h.sequence == b.sequence)
+                out.insert(out.end(), b.levels.begin(), b.levels.end());
+        }
+        return out;
+    }
+
+private:
+    std::mt19937& rng;
+    std::bernoulli_distribution loss;
+    unsigned channels;
+
+    unsigned page = 0;
+    unsigned slot = 0;
+    uint32_t sequence = 0;
+    Log_session session {};
+
+    // Whether power fails before the next step completes
+    bool fails() {
+        if (!loss(rng))
+            return false;
+        losses++;
+        return true;
+    }
+
+    bool write(uint64_t word) {
+        auto& dst = flash[page * LOG_PAGE_SLOTS + slot++];
+        if (fails()) {
+            // Half programmed: only some of the word's zero bits cleared
+            dst = word | std::uniform_int_distribution<uint64_t>()(rng);
+            init();
+            return false;
+        }
+        dst = word;
+        return true;
+    }
+
+    bool writeSession() {
+        const auto payload = std::bit_cast<uint64_t>(session);
+        if (!write(payload) ||
+            !write(std::bit_cast<uint64_t>(Log_trailer::make(0, 1, logCrc(payload, 0xFFFF)))))
+            return false;
+        session.flags &= ~LOG_POWER_UP;
+        return true;
+    }
+
+    bool advance() {
+        const auto next = (page + 1) % LOG_PAGES;
+        if (fails()) {
+            init();        // The erase never started
+            return false;
+        }
+        std::fill_n(flash.begin() + next * LOG_PAGE_SLOTS, LOG_PAGE_SLOTS, FLASH_ERASED);
+        page = next;
+        slot = 0;
+        return write(std::bit_cast<uint64_t>(Log_page_header { LOG_MAGIC, ++sequence })) &&
+               writeSession();
+    }
+
+    bool reserve(unsigned words) {
+        return slot + words <= LOG_PAGE_SLOTS || advance();
+    }
+
+    // As logInit()
+    void init() {
+        bool found = false;
+        for (unsigned p = 0; p < LOG_PAGES; p++) {
+            const auto h = std::bit_cast<Log_page_header>(flash[p * LOG_PAGE_SLOTS]);
+            if (h.magic == LOG_MAGIC && (!found || h.sequence > sequence)) {
+                found = true;
+                page = p;
+                sequence = h.sequence;
+            }
+        }
+
+        if (found) {
+            slot = LOG_PAGE_SLOTS;
+            while (slot > 1 && flash[page * LOG_PAGE_SLOTS + slot - 1] == FLASH_ERASED)
+                slot--;
+        } else {
+            page = LOG_PAGES - 1;
+            slot = LOG_PAGE_SLOTS;
+            sequence = 0;
+        }
+        session = { 1000, LOG_POWER_UP, uint16_t(channels) };
+    }
+};
+
+struct Collector {
+    std::vector<uint16_t> readings;  // Their levels, one reading after another
+    unsigned sessions = 0;
+    unsigned long skipped_words = 0;
+
+    void session(const Log_session&) { sessions++; }
+    void reading(std::span<const uint16_t> l) { readings.insert(readings.end(), l.begin(), l.end()); }
+    void skipped(unsigned words) { skipped_words += words; }
+};
+
+int main(int argc, char *argv[])
+{
+    unsigned runs = 20;
+    for (int opt; (opt = getopt(argc, argv, "r:")) != -1;) {
+        if (opt != 'r') {
+            std::fprintf(stderr, "usage: %s [-r runs]\n", argv[0]);
+            return 2;
+        }
+        runs = std::max(1, std::atoi(optarg));
+    }
+
+    std::mt19937 rng (1);
+    bool pass = true;
+
+    for (unsigned channels : { LOG_CHANNELS, 1u }) {
+        const auto batch = logBatch(channels);
+        for (unsigned s = 0; s < unsigned(Signal::Count); s++) {
+            unsigned bad = 0, words = 0;
+            for (unsigned count = 1; count <= batch; count++) {
+                const auto block = makeBlock(Signal(s), count, channels, rng);
+                bad += !roundTrip(block, channels);
+                words += logPlan(block, channels).words();
+            }
+            std::printf("%-10s %-18s blocks of 1-%u: %u failed, %.1f bits per reading\n",
+                channels > 1 ? "LA/LC/LZ," : "LA alone,", signalName(Signal(s)), batch, bad,
+                words * 64. / (batch * (batch + 1) / 2));
+            pass = pass && bad == 0;
+        }
+    }
+
+    // Half the runs lose power now and then, half never do; and half log
+    // LAeq alone
+    unsigned long readings = 0, lost_blocks = 0;
+    unsigned losses = 0, wrong = 0;
+    for (unsigned run = 0; run < runs; run++) {
+        const bool lossy = run % 2;
+        const unsigned channels = run % 4 < 2 ? LOG_CHANNELS : 1;
+        Flash_log log (rng, lossy ? 400 : 0, channels);
+        std::uniform_int_distribution<unsigned> pick (0, unsigned(Signal::Count) - 1);
+        for (unsigned b = 0; b < 20 * LOG_PAGES * LOG_PAGE_SLOTS / 16; b++) {
+            const auto block = makeBlock(Signal(pick(rng)), logBatch(channels), channels, rng);
+            lost_blocks += !log.append(block);
+        }
+
+        Collector out;
+        logDecodeRegion(log.flash, out);
+        const auto want = log.expected();
+        const bool ok = out.readings == want && (log.losses > 0 || out.skipped_words == 0) &&
+            out.sessions >= LOG_PAGES;
+        if (!ok) {
+            std::printf("run %u: %zu readings decoded, %zu expected, %lu words skipped, "
+                "%u power losses\n", run, out.readings.size() / channels,
+                want.size() / channels, out.skipped_words, log.losses);
+        }
+        wrong += !ok;
+        readings += want.size() / channels;
+        losses += log.losses;
+    }
+    std::printf("%u runs on a %u-page ring: %lu readings decoded, %u power losses, "
+        "%lu blocks lost, %u runs wrong\n", runs, LOG_PAGES, readings, losses, lost_blocks, wrong);
+    pass = pass && wrong == 0;
+
+    std::printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
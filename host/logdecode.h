@@ -0,0 +1,135 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_LOGDECODE_H
+#define HOST_LOGDECODE_H
+
+// Streaming decoder for the flash log (logcodec.h). Double words are fed in
+// flash order, one page after another, and decoded events are passed to a
+// sink as soon as each block's trailer arrives:
+//
+//   sink.session(const Log_session&)     start of a page, or a power-up
+//   sink.reading(std::span<const uint16_t>)  each reading's levels, in the
+//                                        order taken
+//   sink.skipped(unsigned words)         data that did not form a valid block
+
+#include "logcodec.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <span>
+#include <vector>
+
+template<typename Sink>
+class Log_decoder {
+    Sink& sink;
+    std::vector<uint64_t> pending;  // Words since the last block or page start
+    unsigned channels = 0;          // Levels per reading, from the last session
+
+    void skip(std::size_t words) {
+        if (words > 0)
+            sink.skipped(unsigned(words));
+    }
+
+public:
+    explicit Log_decoder(Sink& s): sink(s) {}
+
+    // Starts a new page; `word` is its header
+    void page() {
+        skip(pending.size());
+        pending.clear();
+    }
+
+    void feed(uint64_t word) {
+        if (word == FLASH_ERASED)
+            return;
+
+        const auto t = std::bit_cast<Log_trailer>(word);
+        if (t.valid() && t.words <= pending.size()) {
+            const auto payload = std::span(pending).last(t.words);
+            uint16_t crc = 0xFFFF;
+            for (auto w : payload)
+                crc = logCrc(w, crc);
+
+            if (crc == t.crc && block(payload, t.count)) {
+                skip(pending.size() - t.words);
+                pending.clear();
+                return;
+            }
+        }
+
+        pending.push_back(word);
+    }
+
+    // Ends the stream
+    void finish() {
+        page();
+    }
+
+private:
+    bool block(std::span<const uint64_t> payload, unsigned count) {
+        if (count == 0) {
+            if (payload.size() != 1)
+                return false;
+            const auto s = std::bit_cast<Log_session>(payload[0]);
+            if (s.channels == 0 || s.channels > LOG_CHANNELS)
+                return false;
+            channels = s.channels;
+            sink.session(s);
+            return true;
+        }
+
+        // Every reading block follows a session, on its page or after a
+        // power-up, so one with none before it is left as skipped
+        std::array<uint16_t, 255 * LOG_CHANNELS> levels;
+        if (channels == 0 || !logDecode(payload, std::span(levels).first(count * channels),
+                                        channels))
+            return false;
+        for (unsigned i = 0; i < count; i++)
+            sink.reading(std::span(levels).subspan(i * channels, channels));
+        return true;
+    }
+};
+
+// Decodes a dump of the whole log region, oldest page first
+template<typename Sink>
+void logDecodeRegion(std::span<const uint64_t> region, Sink& sink)
+{
+    struct Page {
+        uint32_t sequence;
+        std::span<const uint64_t> words;
+    };
+
+    std::vector<Page> pages;
+    for (std::size_t i = 0; i + LOG_PAGE_SLOTS <= region.size(); i += LOG_PAGE_SLOTS) {
+        const auto h = std::bit_cast<Log_page_header>(region[i]);
+        if (h.magic == LOG_MAGIC)
+            pages.push_back({ h.sequence, region.subspan(i, LOG_PAGE_SLOTS) });
+    }
+    std::ranges::sort(pages, {}, &Page::sequence);
+
+    Log_decoder dec (sink);
+    for (const auto& p : pages) {
+        dec.page();
+        for (auto w : p.words.subspan(1))
+            dec.feed(w);
+    }
+    dec.finish();
+}
+
+#endif // HOST_LOGDECODE_H
+
@@ -0,0 +1,111 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Decodes a dump of the card's flash log region into CSV, one line per
+// reading: session number, seconds since the session started, then LAeq,
+// LCeq and LZeq in dB (LAeq alone for a LEQ_LOG_LAEQ log). Sessions start at each power-up; the first one shown
+// may have lost its start to the ring wrapping around, and then counts from
+// its oldest surviving reading. A summary goes to stderr.
+//
+// Usage: logdump [-q] log.bin
+
+#include "logdecode.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+struct Printer {
+    bool quiet = false;
+    unsigned sessions = 0;
+    unsigned long readings = 0;
+    unsigned long lost = 0;     // Words that did not form a valid block
+    double seconds = 0;
+    double period = 0;
+
+    void session(const Log_session& s) {
+        if (s.flags & LOG_POWER_UP || sessions == 0) {
+            sessions++;
+            seconds = 0;
+        }
+        period = s.period_ms / 1000.;
+    }
+
+    void reading(std::span<const uint16_t> l) {
+        if (!quiet) {
+            std::printf("%u,%.1f", sessions, seconds);
+            for (unsigned c = 0; c < LOG_CHANNELS; c++) {
+                if (c < l.size())
+                    std::printf(",%.1f", l[c] / 10.);
+                else
+                    std::printf(",");
+            }
+            std::printf("\n");
+        }
+        seconds += period;
+        readings++;
+    }
+
+    void skipped(unsigned words) {
+        lost += words;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    Printer out;
+    std::string path;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg (argv[i]);
+        if (arg == "-q")
+            out.quiet = true;
+        else
+            path = arg;
+    }
+
+    if (path.empty()) {
+        std::fprintf(stderr, "usage: %s [-q] log.bin\n", argv[0]);
+        return 1;
+    }
+
+    std::ifstream file (path, std::ios::binary);
+    const std::vector<char> bytes ((std::istreambuf_iterator<char>(file)),
+                                   std::istreambuf_iterator<char>());
+    if (!file.good() && !file.eof()) {
+        std::fprintf(stderr, "%s: unreadable\n", path.c_str());
+        return 1;
+    }
+
+    std::vector<uint64_t> region (bytes.size() / sizeof(uint64_t));
+    std::memcpy(region.data(), bytes.data(), region.size() * sizeof(uint64_t));
+
+    if (!out.quiet)
+        std::printf("session,seconds,LAeq,LCeq,LZeq\n");
+    logDecodeRegion(region, out);
+
+    std::size_t used = 0;
+    for (auto w : region)
+        used += w != FLASH_ERASED;
+    std::fprintf(stderr, "%s: %lu readings in %u sessions, %lu words skipped, "
+        "%.1f bits per reading\n", path.c_str(), out.readings, out.sessions, out.lost,
+        out.readings ? used * 64. / out.readings : 0.);
+    return 0;
+}
+
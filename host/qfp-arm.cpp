@@ -0,0 +1,31 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Built for the Cortex-M0+ (not the host) by `make qfp`, so that qfp-check
+// can run the routines of qfplib-port.h exactly as the firmware compiles them.
+
+extern "C" {
+#include <qfplib-m0-full.h>
+#include "qfplib-port.h"
+}
+
+// Keeps the inline routines in the object
+[[gnu::used]] static void *const routines[] = {
+    reinterpret_cast<void *>(qfp_fadd_asm),
+    reinterpret_cast<void *>(qfp_fmul_asm),
+    reinterpret_cast<void *>(qfp_int2float_asm),
+};
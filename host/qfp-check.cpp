@@ -0,0 +1,270 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Runs the RAM-resident float routines of qfplib-port.h and the upstream
+// qfplib routines they were taken from in an ARMv6-M emulator (armv6m.h),
+// and checks them bit for bit against each other and against host IEEE
+// arithmetic. The objects are built for the Cortex-M0+ by `make qfp`.
+//
+// Inputs are edge values in every pairing, then random bit patterns, pairs
+// with close exponents (cancellation), short mantissas (exact results and
+// rounding ties) and pairs whose products land near overflow or underflow.
+//
+// qfplib flushes denormal inputs and results to zero and does not produce
+// NaNs, so against IEEE a denormal result is expected as a signed zero and
+// NaN inputs, denormal inputs and invalid operations (Inf - Inf, 0 * Inf)
+// are not compared. The port must match upstream on every input.
+//
+// Each routine's cycles are counted as a Cortex-M0+ executing from
+// zero-wait-state RAM, calls included, and printed as min/mean/max.
+//
+// Usage: qfp-check [-n count] object...
+
+#include "armv6m.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+enum class Op { add, mul, int2float };
+
+struct Routine {
+    const char *name;
+    Op op;
+    const char *upstream;  // Routine that this one must match, if any
+};
+
+static constexpr Routine ROUTINES[] = {
+    { "qfp_fadd",          Op::add,       nullptr },
+    { "qfp_fadd_asm",      Op::add,       "qfp_fadd" },
+    { "qfp_fmul",          Op::mul,       nullptr },
+    { "qfp_fmul_asm",      Op::mul,       "qfp_fmul" },
+    { "qfp_int2float",     Op::int2float, nullptr },
+    { "qfp_int2float_asm", Op::int2float, "qfp_int2float" },
+};
+
+struct Input {
+    uint32_t x, y;
+};
+
+static constexpr uint32_t EDGES[] = {
+    0x00000000, 0x80000000,  // Zeros
+    0x3F800000, 0xBF800000,  // One
+    0x3FC00000, 0x40000000, 0x3F7FFFFF, 0x3F800001,
+    0x00800000, 0x80800000,  // Smallest normals
+    0x00800001, 0x00FFFFFF,
+    0x7F7FFFFF, 0xFF7FFFFF,  // Largest normals
+    0x7F000000, 0x1F800000, 0x5F800000, 0x20000000, 0x5F000000,
+    0x7F800000, 0xFF800000,  // Infinities
+    0x00000001, 0x007FFFFF, 0x807FFFFF,  // Denormals
+    0x7FC00000, 0x7F800001, 0xFFC00000,  // NaNs
+    0x4B000000, 0x4B7FFFFF, 0xCB000001, 0x33800000, 0x34000000,
+};
+
+static constexpr uint32_t INT_EDGES[] = {
+    0, 1, 0xFFFFFFFF, 2, 0x7FFFFFFF, 0x80000000, 0x80000001,
+    0x00FFFFFF, 0x01000000, 0x01000001, 0x01000002, 0x01000003,
+    0x02000002, 0x02000006, 0x7FFFFF80, 0x7FFFFFC0, 0x7FFFFFBF, 0xFEFFFFFF,
+};
+
+static bool isNaN(uint32_t x) { return (x & 0x7FFFFFFF) > 0x7F800000; }
+static bool isDenormal(uint32_t x) { return (x & 0x7F800000) == 0 && (x & 0x007FFFFF) != 0; }
+static bool isInf(uint32_t x) { return (x & 0x7FFFFFFF) == 0x7F800000; }
+static bool isZero(uint32_t x) { return (x & 0x7FFFFFFF) == 0; }
+
+// The IEEE result as qfplib returns it, or nothing where they differ by design
+static std::optional<uint32_t> expected(Op op, uint32_t x, uint32_t y)
+{
+    const auto fx = std::bit_cast<float>(x), fy = std::bit_cast<float>(y);
+    float r = 0;
+
+    switch (op) {
+    case Op::int2float:
+        return std::bit_cast<uint32_t>(float(int32_t(x)));
+    case Op::add:
+        if (isNaN(x) || isNaN(y) || isDenormal(x) || isDenormal(y) ||
+            (isInf(x) && isInf(y) && (x ^ y) >> 31))
+            return {};
+        r = fx + fy;
+        break;
+    case Op::mul:
+        if (isNaN(x) || isNaN(y) || isDenormal(x) || isDenormal(y) ||
+            (isInf(x) && isZero(y)) || (isZero(x) && isInf(y)))
+            return {};
+        r = fx * fy;
+        break;
+    }
+
+    const auto bits = std::bit_cast<uint32_t>(r);
+    return isDenormal(bits) ? bits & 0x80000000 : bits;
+}
+
+static std::vector<Input> inputs(Op op, unsigned count)
+{
+    std::mt19937 rng (1);
+    auto bits = [&rng] { return uint32_t(rng()); };
+    auto normal = [&](int e_lo, int e_hi) {
+        const auto e = std::uniform_int_distribution<int>(e_lo, e_hi)(rng);
+        return (bits() & 0x807FFFFF) | uint32_t(e) << 23;
+    };
+    std::vector<Input> in;
+
+    if (op == Op::int2float) {
+        for (auto x : INT_EDGES) {
+            in.push_back({ x, 0 });
+            in.push_back({ uint32_t(-int32_t(x)), 0 });
+        }
+        for (unsigned i = 0; i < count; i++)
+            in.push_back({ bits(), 0 });
+        for (unsigned i = 0; i < count; i++)
+            in.push_back({ bits() >> (rng() % 32), 0 });
+        // Ties: 25 or more significant bits with a half ULP left over
+        for (unsigned i = 0; i < count; i++) {
+            const auto shift = 1 + rng() % 7;
+            auto x = ((bits() | 0x80000000) >> shift) & ~((1u << (shift + 7)) - 1);
+            x |= 1u << (shift + 6);
+            in.push_back({ bits() & 1 ? x : uint32_t(-int32_t(x)), 0 });
+        }
+        return in;
+    }
+
+    for (auto x : EDGES) {
+        for (auto y : EDGES)
+            in.push_back({ x, y });
+    }
+    for (unsigned i = 0; i < count; i++)
+        in.push_back({ bits(), bits() });
+    for (unsigned i = 0; i < count; i++) {
+        const auto x = normal(1, 254);
+        const int e = std::clamp(int((x >> 23) & 0xFF) + int(rng() % 5) - 2, 1, 254);
+        const auto y = (bits() % 4 ? (x ^ 0x80000000) & ~0x7FFFu : bits()) & 0x807FFFFF;
+        in.push_back({ x, (y ^ (bits() & 0x3FFF)) | uint32_t(e) << 23 });
+    }
+    for (unsigned i = 0; i < count; i++)
+        in.push_back({ normal(107, 147) & 0xFFFF0000, normal(107, 147) & 0xFFFF0000 });
+    for (unsigned i = 0; i < count; i++) {
+        // Products near the smallest normal or past the largest
+        const int ex = std::uniform_int_distribution<int>(1, 254)(rng);
+        const int ey = std::clamp((rng() & 1 ? 127 : 381) - ex + int(rng() % 5) - 2, 1, 254);
+        in.push_back({ normal(ex, ex), normal(ey, ey) });
+    }
+    return in;
+}
+
+struct Result {
+    std::vector<uint32_t> out;
+    uint64_t min = UINT64_MAX, max = 0, total = 0;
+};
+
+static void mismatch(const char *name, const char *against, const Input& in, uint32_t got,
+                     uint32_t want, unsigned& shown)
+{
+    if (shown++ < 5)
+        std::printf("  %s(%08X, %08X) = %08X, %s gives %08X\n", name, in.x, in.y, got, against, want);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned count = 100000;
+    for (int opt; (opt = getopt(argc, argv, "n:")) != -1;) {
+        if (opt != 'n') {
+            std::fprintf(stderr, "usage: %s [-n count] object...\n", argv[0]);
+            return 2;
+        }
+        count = std::strtoul(optarg, nullptr, 0);
+    }
+
+    Armv6m cpu;
+    for (int i = optind; i < argc; i++) {
+        if (!cpu.load(argv[i])) {
+            std::fprintf(stderr, "%s\n", cpu.fault.c_str());
+            return 2;
+        }
+    }
+
+    std::printf("%-18s %8s %8s %8s   %s\n", "routine", "calls", "vs IEEE", "vs ref", "cycles min/mean/max");
+
+    bool pass = true;
+    unsigned found = 0;
+    std::vector<std::pair<const Routine *, Result>> results;
+
+    for (const auto& routine : ROUTINES) {
+        const auto addr = cpu.symbol(routine.name);
+        if (addr == 0) {
+            std::printf("%-18s not found\n", routine.name);
+            continue;
+        }
+        found++;
+
+        const auto in = inputs(routine.op, count);
+        Result res;
+        res.out.reserve(in.size());
+        unsigned ieee_bad = 0, ref_bad = 0, shown = 0;
+
+        const Result *ref = nullptr;
+        for (const auto& [r, rr] : results) {
+            if (routine.upstream && std::string(r->name) == routine.upstream)
+                ref = &rr;
+        }
+
+        for (size_t i = 0; i < in.size(); i++) {
+            const auto out = cpu.call(addr, { in[i].x, in[i].y });
+            if (!cpu.fault.empty()) {
+                std::printf("%s(%08X, %08X): %s\n", routine.name, in[i].x, in[i].y, cpu.fault.c_str());
+                return 1;
+            }
+            res.out.push_back(out);
+            res.min = std::min(res.min, cpu.cycles);
+            res.max = std::max(res.max, cpu.cycles);
+            res.total += cpu.cycles;
+
+            if (const auto want = expected(routine.op, in[i].x, in[i].y); want && *want != out) {
+                ieee_bad++;
+                mismatch(routine.name, "IEEE", in[i], out, *want, shown);
+            }
+            if (ref && ref->out[i] != out) {
+                ref_bad++;
+                mismatch(routine.name, routine.upstream, in[i], out, ref->out[i], shown);
+            }
+        }
+
+        char vsref[16] = "-";
+        if (ref)
+            std::snprintf(vsref, sizeof(vsref), "%u", ref_bad);
+        std::printf("%-18s %8zu %8u %8s   %llu/%.1f/%llu\n", routine.name, in.size(), ieee_bad,
+            vsref, (unsigned long long)res.min, double(res.total) / in.size(),
+            (unsigned long long)res.max);
+
+        pass &= ieee_bad == 0 && ref_bad == 0;
+        results.emplace_back(&routine, std::move(res));
+    }
+
+    if (found == 0) {
+        std::printf("no qfplib routines in the given objects\n");
+        return 2;
+    }
+    std::printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Portable stand-ins for the qfplib routines used by the DSP code, so that
+// sos-iir-filter.h and leq.h can be built and profiled on a host machine.
+// Plain IEEE single-precision arithmetic matches qfplib's correctly rounded
+// add/mul/div/sqrt; the transcendental functions differ in the last bit.
+
+#ifndef QFPLIB_HOST_H
+#define QFPLIB_HOST_H
+
+#include <math.h>
+
+typedef unsigned           int ui32;
+typedef                    int i32;
+
+static inline float qfp_fadd(float x, float y) { return x + y; }
+static inline float qfp_fsub(float x, float y) { return x - y; }
+static inline float qfp_fmul(float x, float y) { return x * y; }
+static inline float qfp_fdiv(float x, float y) { return x / y; }
+static inline float qfp_fsqrt(float x)         { return sqrtf(x); }
+static inline float qfp_fexp(float x)          { return expf(x); }
+static inline float qfp_fln(float x)           { return logf(x); }
+static inline float qfp_int2float(i32 x)       { return (float)x; }
+static inline float qfp_uint2float(ui32 x)     { return (float)x; }
+
+// qfplib rounds towards minus infinity and clamps on overflow
+static inline i32 qfp_float2int(float x)
+{
+    if (!(x > -2147483648.f))
+        return x != x ? 0 : (i32)0x80000000;
+    if (x >= 2147483648.f)
+        return 0x7FFFFFFF;
+    return (i32)floorf(x);
+}
+
+// RAM-resident variants from qfplib-port.h
+static inline float qfp_fadd_asm(float x, float y) { return x + y; }
+static inline float qfp_fmul_asm(float x, float y) { return x * y; }
+static inline float qfp_int2float_asm(int x)       { return (float)x; }
+
+static inline float qfp_fpow(float b, float e)
+{
+    return qfp_fexp(qfp_fmul(e, qfp_fln(b)));
+}
+
+static inline float qfp_flog10(float x)
+{
+    return qfp_fdiv(qfp_fln(x), logf(10.f));
+}
+
+#endif // QFPLIB_HOST_H
+
@@ -0,0 +1,53 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_REFERENCE_H
+#define HOST_REFERENCE_H
+
+// Double-precision model of SOS_IIR_Filter cascades, which the host checks
+// compare the firmware's float and fixed-point filters against.
+
+#include "sos-iir-filter.h"
+
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Runs the given filters' sections in order, with the same (float)
+// coefficients. Gains are collected in `gain` rather than applied.
+struct Reference {
+    double gain = 1;
+    std::vector<std::array<double, 6>> sos;  // b1 b2 a1 a2 w0 w1
+
+    template<std::size_t N>
+    void append(const SOS_IIR_Filter<N>& f) {
+        gain *= f.gain;
+        for (const auto& c : f.sos)
+            sos.push_back({ c.b1, c.b2, c.a1, c.a2, 0, 0 });
+    }
+
+    double operator()(double s) {
+        for (auto& [b1, b2, a1, a2, w0, w1] : sos) {
+            const auto f6 = s + a1 * w0 + a2 * w1;
+            s = f6 + b1 * w0 + b2 * w1;
+            w1 = std::exchange(w0, f6);
+        }
+        return s;
+    }
+};
+
+#endif // HOST_REFERENCE_H
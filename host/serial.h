@@ -0,0 +1,103 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_SERIAL_H
+#define HOST_SERIAL_H
+
+// Serial port access for the link tools: opens a port in raw 8N1, or a
+// capture file as is, and writes frames in the linkframe.h format.
+
+#include "linkframe.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+struct Serial {
+    int fd = -1;
+    bool port = false;  // False for a capture file, which is only read
+};
+
+inline speed_t serialSpeed(unsigned baud)
+{
+    switch (baud) {
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default:     return B0;
+    }
+}
+
+// Prints the reason and returns false on failure
+inline bool serialOpen(const std::string& path, unsigned baud, Serial& s)
+{
+    s.fd = open(path.c_str(), O_RDWR | O_NOCTTY);
+    struct stat st;
+    if (s.fd < 0 || fstat(s.fd, &st) != 0) {
+        std::fprintf(stderr, "%s: %s\n", path.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    s.port = S_ISCHR(st.st_mode);
+    if (!s.port)
+        return true;
+
+    termios t;
+    const auto speed = serialSpeed(baud);
+    if (speed == B0 || tcgetattr(s.fd, &t) != 0) {
+        std::fprintf(stderr, "%s: cannot use %u baud\n", path.c_str(), baud);
+        return false;
+    }
+    cfmakeraw(&t);
+    cfsetispeed(&t, speed);
+    cfsetospeed(&t, speed);
+    t.c_cflag |= CLOCAL | CREAD;
+    t.c_cflag &= ~(CSTOPB | CRTSCTS);
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    if (tcsetattr(s.fd, TCSANOW, &t) != 0) {
+        std::fprintf(stderr, "%s: not a serial port\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Sends one frame; does nothing when reading a capture file
+inline bool serialSend(const Serial& s, Link_type type, std::span<const uint8_t> payload = {})
+{
+    if (!s.port)
+        return true;
+
+    const auto header = linkHeader(type, uint16_t(payload.size()));
+    const auto crc = crc16(payload.data(), payload.size(), linkCrc(type, uint16_t(payload.size())));
+    std::vector<uint8_t> frame (header.begin(), header.end());
+    frame.insert(frame.end(), payload.begin(), payload.end());
+    frame.push_back(uint8_t(crc));
+    frame.push_back(uint8_t(crc >> 8));
+    return write(s.fd, frame.data(), frame.size()) == ssize_t(frame.size());
+}
+
+#endif // HOST_SERIAL_H
+
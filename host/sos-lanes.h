@@ -0,0 +1,162 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_SOS_LANES_H
+#define HOST_SOS_LANES_H
+
+// Runs one float SOS_IIR_Filter design over L independent channels at once.
+// The recursion cannot be vectorized along time, but it can across
+// channels: each SIMD lane holds one channel, and samples are interleaved
+// by channel (frame t of channel c at [t * L + c]).
+//
+// Each lane performs the same float operations in the same order as
+// SOS_IIR_Filter<N> with the host backend, so every channel's output
+// matches it bit for bit. AVX2 or SSE is chosen at run time, with scalar
+// code as the fallback.
+
+#include "sos-iir-filter.h"
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+
+enum class Lanes_isa { scalar, sse, avx2 };
+
+inline Lanes_isa lanes_best_isa()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+        return Lanes_isa::avx2;
+    if (__builtin_cpu_supports("sse"))
+        return Lanes_isa::sse;
+#endif
+    return Lanes_isa::scalar;
+}
+
+inline bool lanes_supported(Lanes_isa isa)
+{
+    return isa <= lanes_best_isa();
+}
+
+inline const char *lanes_isa_name(Lanes_isa isa)
+{
+    return isa == Lanes_isa::avx2 ? "avx2" : isa == Lanes_isa::sse ? "sse" : "scalar";
+}
+
+template<std::size_t N, unsigned L>
+struct SOS_IIR_Lanes {
+  static_assert(L % 8 == 0, "channel count must fill whole AVX2 vectors");
+
+  struct Coefficients {
+    float b1, b2, a1, a2;
+  };
+
+  float gain;
+  std::array<Coefficients, N> sos;
+  alignas(32) float w0[N][L] {};
+  alignas(32) float w1[N][L] {};
+  Lanes_isa isa;
+
+  explicit SOS_IIR_Lanes(const SOS_IIR_Filter<N>& f, Lanes_isa isa_ = lanes_best_isa()):
+    gain(f.gain), isa(lanes_supported(isa_) ? isa_ : lanes_best_isa())
+  {
+    for (std::size_t i = 0; i < N; i++)
+      sos[i] = { f.sos[i].b1, f.sos[i].b2, f.sos[i].a1, f.sos[i].a2 };
+  }
+
+  // Filters `frames` interleaved frames in place
+  void filter(float *x, std::size_t frames) {
+    run<false>(x, frames, nullptr);
+  }
+
+  // Adds each channel's sum of squared outputs, times gain squared as in
+  // SOS_IIR_Filter::sum_sqr_of(), to `sums`. Leaves the samples untouched.
+  void sum_sqr_of(const float *x, std::size_t frames, float (&sums)[L]) {
+    run<true>(const_cast<float *>(x), frames, sums);
+  }
+
+private:
+  template<bool Sum>
+  void run(float *x, std::size_t frames, float *sums) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (isa == Lanes_isa::avx2)
+      return run_avx2<Sum>(x, frames, sums);
+    if (isa == Lanes_isa::sse)
+      return run_sse<Sum>(x, frames, sums);
+#endif
+    run_lanes<float, Sum>(x, frames, sums);
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  typedef float float4 __attribute__((vector_size(16)));
+  typedef float float8 __attribute__((vector_size(32)));
+
+  template<bool Sum>
+  [[gnu::target("avx2")]] void run_avx2(float *x, std::size_t frames, float *sums) {
+    run_lanes<float8, Sum>(x, frames, sums);
+  }
+
+  template<bool Sum>
+  [[gnu::target("sse")]] void run_sse(float *x, std::size_t frames, float *sums) {
+    run_lanes<float4, Sum>(x, frames, sums);
+  }
+#endif
+
+  // The kernel, for V holding W = sizeof(V) / sizeof(float) channels. State
+  // stays in registers across the block; inlined into each target above.
+  template<typename V, bool Sum>
+  [[gnu::always_inline]] inline void run_lanes(float *x, std::size_t frames, float *sums) {
+    constexpr unsigned W = sizeof(V) / sizeof(float);
+
+    for (unsigned g = 0; g < L; g += W) {
+      V s0[N], s1[N], acc {};
+      for (std::size_t i = 0; i < N; i++) {
+        std::memcpy(&s0[i], &w0[i][g], sizeof(V));
+        std::memcpy(&s1[i], &w1[i][g], sizeof(V));
+      }
+
+      for (std::size_t t = 0; t < frames; t++) {
+        V s;
+        std::memcpy(&s, x + t * L + g, sizeof(V));
+        for (std::size_t i = 0; i < N; i++) {
+          const auto& c = sos[i];
+          const V f6 = s + c.a1 * s0[i] + c.a2 * s1[i];
+          s = f6 + c.b1 * s0[i] + c.b2 * s1[i];
+          s1[i] = s0[i];
+          s0[i] = f6;
+        }
+        if constexpr (Sum)
+          acc = acc + s * s;
+        else
+          std::memcpy(x + t * L + g, &s, sizeof(V));
+      }
+
+      for (std::size_t i = 0; i < N; i++) {
+        std::memcpy(&w0[i][g], &s0[i], sizeof(V));
+        std::memcpy(&w1[i][g], &s1[i], sizeof(V));
+      }
+      if constexpr (Sum) {
+        acc = acc * gain * gain;
+        float out[W];
+        std::memcpy(out, &acc, sizeof(V));
+        for (unsigned j = 0; j < W; j++)
+          sums[g + j] += out[j];
+      }
+    }
+  }
+};
+
+#endif // HOST_SOS_LANES_H
@@ -0,0 +1,118 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_TEST_SIGNALS_H
+#define HOST_TEST_SIGNALS_H
+
+// Test signals for the checks that run filters in the ARMv6-M emulator
+// (cascade-check, unroll-check), and copies between host and emulator memory.
+
+#include "armv6m.h"
+#include "leqconfig.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+template<typename T>
+struct Signal {
+    const char *name;
+    std::vector<T> x;
+};
+
+// A MIC_BITS-wide sample as the filters under test take it: left-justified
+// in an int32_t, or as Leq_ingest passes it on in an sos_t
+template<typename T>
+constexpr T testSample(int32_t s)
+{
+    if constexpr (std::is_same_v<T, int32_t>)
+        return s << (32 - MIC_BITS);
+    else
+        return T(float(s << SAMPLE_SHIFT));
+}
+
+// Silence, an impulse, noise at several levels, tones and a full-scale
+// square wave, `length` samples each; int32_t signals add random words that
+// use the full 32 bits, INT32_MIN and INT32_MAX included
+template<typename T>
+std::vector<Signal<T>> testSignals(std::size_t length)
+{
+    constexpr auto full = int32_t((1u << (MIC_BITS - 1)) - 1);
+    std::mt19937 rng (1);
+    std::normal_distribution<double> normal;
+    std::vector<Signal<T>> out;
+
+    auto add = [&](const char *name, auto gen) {
+        Signal<T> s { name, std::vector<T>(length) };
+        for (std::size_t n = 0; n < length; n++)
+            s.x[n] = testSample<T>(gen(n));
+        out.push_back(std::move(s));
+    };
+    auto noise = [&](double dBFS) {
+        const auto rms = full * std::pow(10., dBFS / 20);
+        return [&, rms](std::size_t) {
+            return int32_t(std::clamp<double>(std::round(rms * normal(rng)), -full, full));
+        };
+    };
+    auto tone = [&](double freq) {
+        return [freq, full](std::size_t n) {
+            return int32_t(std::lround(full * std::sin(2 * M_PI * freq * n / SAMPLE_RATE)));
+        };
+    };
+
+    add("silence", [](std::size_t) { return 0; });
+    add("impulse", [](std::size_t n) { return n == 0 ? full : 0; });
+    add("noise 0", noise(0));
+    add("noise -40", noise(-40));
+    add("noise -100", noise(-100));
+    add("tone 20", tone(20));
+    add("tone 1k", tone(1000));
+    add("tone 16k", tone(16000));
+    add("square", [](std::size_t n) { return n / 100 % 2 ? -full : full; });
+
+    if constexpr (std::is_same_v<T, int32_t>) {
+        Signal<T> s { "words", std::vector<T>(length) };
+        for (std::size_t n = 0; n < length; n++) {
+            const auto w = uint32_t(rng());
+            s.x[n] = n % 7 == 0 ? INT32_MIN : n % 11 == 0 ? INT32_MAX : int32_t(w >> (w % 32));
+        }
+        out.push_back(std::move(s));
+    }
+    return out;
+}
+
+inline void writeWords(Armv6m& cpu, uint32_t addr, const void *data, std::size_t bytes)
+{
+    std::vector<uint32_t> w (bytes / 4);
+    std::memcpy(w.data(), data, bytes);
+    for (std::size_t i = 0; i < w.size(); i++)
+        cpu.write32(addr + i * 4, w[i]);
+}
+
+inline void readWords(Armv6m& cpu, uint32_t addr, void *data, std::size_t bytes)
+{
+    std::vector<uint32_t> w (bytes / 4);
+    for (std::size_t i = 0; i < w.size(); i++)
+        w[i] = cpu.read32(addr + i * 4);
+    std::memcpy(data, w.data(), bytes);
+}
+
+#endif // HOST_TEST_SIGNALS_H
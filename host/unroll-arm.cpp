@@ -0,0 +1,64 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Built for the Cortex-M0+ (not the host) by `make unroll`, so that
+// unroll-check can size and time SOS_IIR_Filter and SOS_IIR_Static as the
+// firmware compiles them.
+//
+// unroll_<template>_<filter>(x, n) runs a block of n samples through one
+// of leq.h's filters as Leq_accumulate() would: in place with filter() for
+// the equalizers, or through sum_sqr_of() for the weightings, whose sum it
+// returns. Each is flattened, so that its symbol size is the code that one
+// call site costs. unroll_reset() clears all delay state.
+
+#include "leq.h"
+
+template<const auto& F>
+struct Pair {
+    static inline auto dynamic = sos_filter_cast<sos_t>(F);
+    static inline SOS_IIR_Static<F> fixed {};
+
+    static void reset() {
+        dynamic.w = {};
+        fixed.w = {};
+    }
+};
+
+#define UNROLL_FILTER(name, F)                                                     \
+    extern "C" RAMFUNC [[gnu::flatten]] float unroll_dynamic_##name(sos_t *x, unsigned n) \
+        { Pair<F>::dynamic.filter(std::views::counted(x, n)); return 0.f; }       \
+    extern "C" RAMFUNC [[gnu::flatten]] float unroll_static_##name(sos_t *x, unsigned n)  \
+        { Pair<F>::fixed.filter(std::views::counted(x, n)); return 0.f; }
+
+#define UNROLL_SUM_SQR(name, F)                                                    \
+    extern "C" RAMFUNC [[gnu::flatten]] float unroll_dynamic_##name(sos_t *x, unsigned n) \
+        { return Pair<F>::dynamic.sum_sqr_of(std::views::counted(x, n)); }        \
+    extern "C" RAMFUNC [[gnu::flatten]] float unroll_static_##name(sos_t *x, unsigned n)  \
+        { return Pair<F>::fixed.sum_sqr_of(std::views::counted(x, n)); }
+
+UNROLL_FILTER(eq, MIC_EQUALIZER)
+UNROLL_FILTER(mic, MIC_DESIGN)
+UNROLL_SUM_SQR(a, A_DESIGN)
+UNROLL_SUM_SQR(c, C_DESIGN)
+
+extern "C" void unroll_reset()
+{
+    Pair<MIC_EQUALIZER>::reset();
+    Pair<MIC_DESIGN>::reset();
+    Pair<A_DESIGN>::reset();
+    Pair<C_DESIGN>::reset();
+}
@@ -0,0 +1,271 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Compares SOS_IIR_Static, which the SOS_UNROLLED build runs for every
+// filter and the default build for those with SOS_zeros numerators, with
+// SOS_IIR_Filter over leq.h's filters: the full microphone equalizer (with
+// the DC blocker that Leq_ingest takes over), the equalizer as run, and the
+// A, C and Z weightings.
+//
+// On the host, each filters silence, an impulse, noise at several levels,
+// tones and a full-scale square wave through both templates, in blocks
+// that take turns at filter(), filter_sum_sqr() and sum_sqr_of(). Every
+// output sample, the delay state after each block and each sum must be
+// equal. Each filter's soft-float multiplies and adds per sample are
+// listed, with host ns/sample for sum_sqr_of().
+//
+// Given upstream qfplib and the Cortex-M0+ build of unroll-arm.cpp (made by
+// `make unroll`, in that order), both templates also run in the ARMv6-M
+// emulator as the firmware compiles them, and must agree there as well.
+// Their code bytes and cycles per sample are printed.
+//
+// Usage: unroll-check [-s seconds] [object...]
+
+#include "leq.h"
+#include "test-signals.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static constexpr unsigned BLOCK = 64;
+
+// Where each template's block is placed in the emulator
+static constexpr uint32_t DYNAMIC = 0x20080000;
+static constexpr uint32_t STATIC  = 0x20081000;
+
+// Soft-float multiplies and adds per sample and section, not counting the
+// sum of squares
+struct Ops {
+    unsigned mul = 0, add = 0;
+};
+
+template<const auto& F>
+constexpr Ops staticOps()
+{
+    Ops ops;
+    for (const auto& s : F.sos) {
+        for (float c : { float(s.b1), float(s.b2), float(s.a1), float(s.a2) }) {
+            if (c == 0.f)
+                continue;
+            else if (c == 1.f || c == -1.f)
+                ops.add += 1;
+            else if (c == 2.f || c == -2.f)
+                ops.add += 2;
+            else
+                ops.mul++, ops.add++;
+        }
+    }
+    return ops;
+}
+
+static std::string opsString(Ops ops)
+{
+    return std::to_string(ops.mul) + "+" + std::to_string(ops.add);
+}
+
+class Check
+{
+public:
+    Armv6m& cpu;
+    bool arm;
+    unsigned mismatches = 0;
+    bool faulted = false;
+
+    // `symbol` names the filter's unroll-arm.cpp functions, if any
+    template<const auto& F>
+    void run(const char *name, const char *symbol, const std::vector<Signal<sos_t>>& sigs) {
+        constexpr std::size_t N = F.sos.size();
+        for (const auto& s : sigs)
+            runSignal<F>(name, s);
+
+        const auto& x = sigs.front().x;
+        const Ops dynamic { unsigned(4 * N), unsigned(4 * N) };
+        std::printf("%-10s %8zu %8s %8s %8.2f %8.2f", name, N, opsString(dynamic).c_str(),
+            opsString(staticOps<F>()).c_str(),
+            timeHost(sos_filter_cast<sos_t>(F), x), timeHost(SOS_IIR_Static<F> {}, x));
+        if (arm && symbol)
+            runArm(name, symbol, sigs);
+        std::printf("\n");
+    }
+
+private:
+    template<const auto& F>
+    void runSignal(const char *name, const Signal<sos_t>& sig) {
+        constexpr std::size_t N = F.sos.size();
+        auto dynamic = sos_filter_cast<sos_t>(F);
+        SOS_IIR_Static<F> fixed {};
+
+        unsigned shown = 0;
+        for (std::size_t i = 0; i + BLOCK <= sig.x.size(); i += BLOCK) {
+            std::array<sos_t, BLOCK> want, got;
+            std::copy_n(sig.x.begin() + i, BLOCK, want.begin());
+            got = want;
+            auto w = std::views::all(want);
+            auto g = std::views::all(got);
+
+            sos_t want_sum, got_sum;
+            switch (i / BLOCK % 3) {
+            case 0:
+                dynamic.filter(w);
+                fixed.filter(g);
+                break;
+            case 1:
+                if constexpr (N > 0) {
+                    want_sum = dynamic.filter_sum_sqr(w);
+                    got_sum = fixed.filter_sum_sqr(g);
+                    break;
+                }
+                [[fallthrough]];
+            default:
+                want_sum = dynamic.sum_sqr_of(want);
+                got_sum = fixed.sum_sqr_of(got);
+                break;
+            }
+
+            for (unsigned j = 0; j < BLOCK; j++) {
+                if (float(got[j]) != float(want[j]))
+                    report(shown, name, sig.name, i + j, "output", got[j], want[j]);
+            }
+            for (std::size_t k = 0; k < N; k++) {
+                const auto& gs = fixed.w[k];
+                const auto& ws = dynamic.w[k];
+                if (float(gs.w0) != float(ws.w0) || float(gs.w1) != float(ws.w1))
+                    report(shown, name, sig.name, i, "state", gs.w0, ws.w0);
+            }
+            if (float(got_sum) != float(want_sum))
+                report(shown, name, sig.name, i, "sum of squares", got_sum, want_sum);
+        }
+    }
+
+    // Best of three ns per sample for sum_sqr_of() over x
+    static double timeHost(auto filter, const std::vector<sos_t>& x) {
+        double best = 0;
+        for (int r = 0; r < 3; r++) {
+            filter.w = {};
+            volatile float sink = 0;
+            const auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i + BLOCK <= x.size(); i += BLOCK)
+                sink = sink + float(filter.sum_sqr_of(std::views::counted(x.data() + i, BLOCK)));
+            const auto end = std::chrono::steady_clock::now();
+            const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+            if (r == 0 || ns < best)
+                best = ns;
+        }
+        return best / double(x.size() / BLOCK * BLOCK);
+    }
+
+    void runArm(const char *name, const char *symbol, const std::vector<Signal<sos_t>>& sigs) {
+        const std::string d = std::string("unroll_dynamic_") + symbol;
+        const std::string s = std::string("unroll_static_") + symbol;
+        const auto reset = cpu.symbol("unroll_reset");
+        const auto fd = cpu.symbol(d), fs = cpu.symbol(s);
+        if (!reset || !fd || !fs) {
+            std::printf("  (%s or %s not loaded)", d.c_str(), s.c_str());
+            return;
+        }
+
+        uint64_t dynamic_cycles = 0, static_cycles = 0, samples = 0;
+        for (const auto& sig : sigs) {
+            cpu.call(reset, {});
+            unsigned shown = 0;
+            for (std::size_t i = 0; i + BLOCK <= sig.x.size(); i += BLOCK) {
+                writeWords(cpu, DYNAMIC, sig.x.data() + i, BLOCK * sizeof(sos_t));
+                writeWords(cpu, STATIC, sig.x.data() + i, BLOCK * sizeof(sos_t));
+                const auto want = std::bit_cast<float>(cpu.call(fd, { DYNAMIC, BLOCK }));
+                dynamic_cycles += cpu.cycles;
+                if (!cpu.fault.empty())
+                    return fault(name, sig.name, i);
+                const auto got = std::bit_cast<float>(cpu.call(fs, { STATIC, BLOCK }));
+                static_cycles += cpu.cycles;
+                if (!cpu.fault.empty())
+                    return fault(name, sig.name, i);
+                samples += BLOCK;
+
+                std::array<float, BLOCK> gs, ws;
+                readWords(cpu, STATIC, gs.data(), sizeof(gs));
+                readWords(cpu, DYNAMIC, ws.data(), sizeof(ws));
+                for (unsigned j = 0; j < BLOCK; j++) {
+                    if (gs[j] != ws[j])
+                        report(shown, name, sig.name, i + j, "Cortex-M0+ output", gs[j], ws[j]);
+                }
+                if (got != want)
+                    report(shown, name, sig.name, i, "Cortex-M0+ sum of squares", got, want);
+            }
+        }
+
+        std::printf(" %8u %8u %8.1f %8.1f", cpu.symbolSize(d), cpu.symbolSize(s),
+            double(dynamic_cycles) / samples, double(static_cycles) / samples);
+    }
+
+    void report(unsigned& shown, const char *filter, const char *signal, std::size_t n,
+                const char *what, sos_t got, sos_t want) {
+        mismatches++;
+        if (shown++ < 5) {
+            std::printf("\n  %s, %s, sample %zu: %s %.9g, SOS_IIR_Filter gives %.9g", filter,
+                signal, n, what, float(got), float(want));
+        }
+    }
+
+    void fault(const char *filter, const char *signal, std::size_t n) {
+        std::printf("\n  %s, %s, sample %zu: %s", filter, signal, n, cpu.fault.c_str());
+        faulted = true;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    double seconds = 0.5;
+    for (int opt; (opt = getopt(argc, argv, "s:")) != -1;) {
+        if (opt != 's') {
+            std::fprintf(stderr, "usage: %s [-s seconds] [object...]\n", argv[0]);
+            return 2;
+        }
+        seconds = std::atof(optarg);
+    }
+
+    Armv6m cpu;
+    for (int i = optind; i < argc; i++) {
+        if (!cpu.load(argv[i])) {
+            std::fprintf(stderr, "%s\n", cpu.fault.c_str());
+            return 2;
+        }
+    }
+
+    Check check { cpu, optind < argc };
+    const auto sigs = testSignals<sos_t>(std::size_t(seconds * SAMPLE_RATE) / BLOCK * BLOCK);
+    std::printf("%zu signals of %.2f s in blocks of %u; SOS_IIR_Filter against SOS_IIR_Static\n",
+        sigs.size(), seconds, BLOCK);
+    std::printf("%-10s %8s %17s %17s", "filter", "sections", "mul+add/sample", "host ns/sample");
+    if (check.arm)
+        std::printf(" %17s %17s", "M0+ code bytes", "M0+ cycles/sample");
+    std::printf("\n");
+
+    check.run<MIC_EQUALIZER>("dc+eq", "eq", sigs);
+    check.run<MIC_DESIGN>("equalizer", "mic", sigs);
+    check.run<A_DESIGN>("A", "a", sigs);
+    check.run<C_DESIGN>("C", "c", sigs);
+    check.run<Z_DESIGN>("Z", nullptr, sigs);
+
+    const bool pass = !check.faulted && check.mismatches == 0;
+    std::printf("%u mismatches: %s\n", check.mismatches, pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
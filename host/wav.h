@@ -0,0 +1,209 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_WAV_H
+#define HOST_WAV_H
+
+// Minimal WAV reader for the host tools: PCM 16/24/32-bit and 32-bit float,
+// first channel only, returned as left-justified 32-bit samples, either
+// read in whole or mapped. Also writes mono 32-bit float files.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct WavFile {
+    unsigned rate = 0;
+    unsigned channels = 0;
+    unsigned bits = 0;
+    std::vector<int32_t> samples;
+};
+
+// Format and PCM data of a WAV file held in memory, read in place
+struct WavView {
+    unsigned rate = 0;
+    unsigned channels = 0;
+    unsigned bits = 0;
+    bool isfloat = false;
+    const uint8_t *pcm = nullptr;
+    size_t frames = 0;
+
+    // First channel of frame n as a left-justified 32-bit sample
+    int32_t sample(size_t n) const {
+        const auto p = pcm + n * (channels * bits / 8);
+        const auto u16 = uint32_t(p[0] | (p[1] << 8));
+
+        if (bits == 16)
+            return int32_t(u16 << 16);
+        if (bits == 24)
+            return int32_t((u16 | (uint32_t(p[2]) << 16)) << 8);
+
+        const auto u32 = u16 | (uint32_t(p[2] | (p[3] << 8)) << 16);
+        if (!isfloat)
+            return int32_t(u32);
+        float f;
+        std::memcpy(&f, &u32, sizeof(f));
+        const double v = std::clamp(double(f), -1.0, 1.0) * 2147483648.0;
+        return int32_t(std::clamp(v, -2147483648.0, 2147483647.0));
+    }
+};
+
+inline bool wavParse(const uint8_t *data, size_t length, WavView& wav)
+{
+    auto u16 = [&](size_t i) { return uint32_t(data[i] | (data[i + 1] << 8)); };
+    auto u32 = [&](size_t i) { return u16(i) | (u16(i + 2) << 16); };
+
+    if (length < 12 || std::memcmp(data, "RIFF", 4) || std::memcmp(data + 8, "WAVE", 4))
+        return false;
+
+    unsigned format = 0;
+    size_t pcm = 0, pcmsize = 0;
+    for (size_t i = 12; i + 8 <= length;) {
+        const auto size = u32(i + 4);
+        const auto body = i + 8;
+
+        if (!std::memcmp(&data[i], "fmt ", 4) && body + 16 <= length) {
+            format = u16(body);
+            wav.channels = u16(body + 2);
+            wav.rate = u32(body + 4);
+            wav.bits = u16(body + 14);
+            if (format == 0xFFFE && size >= 26)
+                format = u16(body + 24); // WAVE_FORMAT_EXTENSIBLE sub-format
+        } else if (!std::memcmp(&data[i], "data", 4)) {
+            pcm = body;
+            pcmsize = std::min<size_t>(size, length - body);
+        }
+
+        i = body + size + (size & 1);
+    }
+
+    const bool isint = format == 1 && (wav.bits == 16 || wav.bits == 24 || wav.bits == 32);
+    wav.isfloat = format == 3 && wav.bits == 32;
+    if (pcm == 0 || wav.channels == 0 || !(isint || wav.isfloat))
+        return false;
+
+    wav.pcm = data + pcm;
+    wav.frames = pcmsize / (wav.channels * wav.bits / 8);
+    return true;
+}
+
+inline bool wavRead(const std::string& path, WavFile& wav)
+{
+    auto fp = std::fopen(path.c_str(), "rb");
+    if (fp == nullptr)
+        return false;
+
+    std::vector<uint8_t> data;
+    uint8_t chunk[65536];
+    for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), fp)) > 0;)
+        data.insert(data.end(), chunk, chunk + n);
+    std::fclose(fp);
+
+    WavView view;
+    if (!wavParse(data.data(), data.size(), view))
+        return false;
+
+    wav.rate = view.rate;
+    wav.channels = view.channels;
+    wav.bits = view.bits;
+    wav.samples.resize(view.frames);
+    for (size_t n = 0; n < wav.samples.size(); n++)
+        wav.samples[n] = view.sample(n);
+
+    return true;
+}
+
+// A WAV file mapped into memory, for inputs too long to read in whole
+class WavMap {
+public:
+    WavView view;
+
+    WavMap() = default;
+    WavMap(const WavMap&) = delete;
+    WavMap& operator=(const WavMap&) = delete;
+
+    ~WavMap() {
+        if (data != nullptr)
+            munmap(data, length);
+    }
+
+    bool open(const std::string& path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            length = size_t(st.st_size);
+            data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+                data = nullptr;
+        }
+        ::close(fd);
+
+        if (data == nullptr)
+            return false;
+        madvise(data, length, MADV_SEQUENTIAL);
+        return wavParse(static_cast<const uint8_t *>(data), length, view);
+    }
+
+private:
+    void *data = nullptr;
+    size_t length = 0;
+};
+
+inline bool wavWrite(const std::string& path, unsigned rate, const std::vector<float>& samples)
+{
+    auto fp = std::fopen(path.c_str(), "wb");
+    if (fp == nullptr)
+        return false;
+
+    std::vector<uint8_t> data;
+    auto u16 = [&](uint32_t v) { data.push_back(uint8_t(v)); data.push_back(uint8_t(v >> 8)); };
+    auto u32 = [&](uint32_t v) { u16(v & 0xFFFF); u16(v >> 16); };
+    auto tag = [&](const char *t) { data.insert(data.end(), t, t + 4); };
+
+    const auto bytes = uint32_t(samples.size() * sizeof(float));
+    tag("RIFF"); u32(4 + 8 + 16 + 8 + bytes); tag("WAVE");
+    tag("fmt "); u32(16);
+    u16(3);                     // IEEE float
+    u16(1);                     // Mono
+    u32(rate);
+    u32(rate * sizeof(float));  // Bytes per second
+    u16(sizeof(float));         // Block alignment
+    u16(32);
+    tag("data"); u32(bytes);
+    for (auto f : samples) {
+        uint32_t u;
+        std::memcpy(&u, &f, sizeof(u));
+        u32(u);
+    }
+
+    const bool ok = std::fwrite(data.data(), 1, data.size(), fp) == data.size();
+    return std::fclose(fp) == 0 && ok;
+}
+
+#endif // HOST_WAV_H
+
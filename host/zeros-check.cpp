@@ -0,0 +1,110 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks what sos_snap_zeros() does to leq.h's filters, whose numerators in
+// the SOS_zeros forms SOS_IIR_Static then runs without multiplies.
+//
+// Each of the equalizer and the A and C weightings, as designed (before
+// leqconfig.h snaps them), is snapped with the given tolerance (default
+// LEQ_ZEROS_TOLERANCE). The sections then run without multiplies are
+// listed, along with the response error this introduces, in dB, at each
+// one-third-octave frequency from 10 Hz to 20 kHz where it reaches
+// 0.001 dB. The check fails if an error exceeds max_dB (default 0.01).
+// unroll-check covers the outputs of the multiply-free sections, which
+// must equal SOS_IIR_Filter's.
+//
+// Usage: zeros-check [-t tolerance] [max_dB]
+
+#include "leq.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+static constexpr double BANDS[] = {
+    10, 12.5, 16, 20, 25, 31.5, 40, 50, 63, 80, 100, 125, 160, 200, 250, 315, 400, 500,
+    630, 800, 1000, 1250, 1600, 2000, 2500, 3150, 4000, 5000, 6300, 8000, 10000,
+    12500, 16000, 20000
+};
+
+static const char *zerosName(SOS_zeros z)
+{
+    switch (z) {
+    case SOS_zeros::Dc:       return "1-z";
+    case SOS_zeros::Dc2:      return "(1-z)^2";
+    case SOS_zeros::Nyquist:  return "1+z";
+    case SOS_zeros::Nyquist2: return "(1+z)^2";
+    default:                  return "general";
+    }
+}
+
+// Returns the largest response error in dB
+template<std::size_t N>
+static double check(const char *name, const SOS_IIR_Filter<N>& design, double tolerance)
+{
+    const auto snapped = sos_snap_zeros(design, tolerance, SAMPLE_RATE);
+    double max_dB = 0;
+
+    std::printf("%s: gain %.9g -> %.9g, sections", name, float(design.gain), float(snapped.gain));
+    for (const auto& c : snapped.sos)
+        std::printf(" %s", zerosName(sos_zeros_of(c)));
+    std::printf("\n ");
+
+    // Bands moved by at least 0.001 dB
+    unsigned shown = 0;
+    for (double f : BANDS) {
+        const double err = 20 * std::log10(sos_magnitude(snapped, f, SAMPLE_RATE) /
+                                           sos_magnitude(design, f, SAMPLE_RATE));
+        max_dB = std::max(max_dB, std::abs(err));
+        if (std::abs(err) >= 0.001) {
+            std::printf(" %g:%+.3f", f, err);
+            if (++shown % 8 == 0)
+                std::printf("\n ");
+        }
+    }
+    if (shown == 0)
+        std::printf(" response unchanged");
+    std::printf("\n  max error %.4f dB\n", max_dB);
+    return max_dB;
+}
+
+int main(int argc, char *argv[])
+{
+    double tolerance = LEQ_ZEROS_TOLERANCE;
+    for (int opt; (opt = getopt(argc, argv, "t:")) != -1;) {
+        if (opt != 't') {
+            std::fprintf(stderr, "usage: %s [-t tolerance] [max_dB]\n", argv[0]);
+            return 2;
+        }
+        tolerance = std::atof(optarg);
+    }
+    const double max_dB = optind < argc ? std::atof(argv[optind]) : 0.01;
+
+    std::printf("snapping numerators within %g, response error in dB\n", tolerance);
+    const double errors[] = {
+        check("equalizer", MIC_EQUALIZER, tolerance),
+        check("A", sos_cascade<WEIGHTING_A>(), tolerance),
+        check("C", sos_cascade<WEIGHTING_C>(), tolerance),
+    };
+
+    bool pass = true;
+    for (double e : errors)
+        pass = pass && e <= max_dB;
+    std::printf("max error %.2f dB allowed: %s\n", max_dB, pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
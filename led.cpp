@@ -0,0 +1,141 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "hal.h"
+#include "led.h"
+
+// TIM14 counts microseconds with a 1 ms period. Each period lights at most
+// one LED, from the update event until the CC1 match at `duty` ticks, so the
+// supply never carries more than one LED's current.
+static constexpr unsigned LED_TICK_HZ    = 1'000'000;
+static constexpr unsigned LED_PERIOD     = 1000;            // Ticks per PWM period
+static constexpr unsigned LED_DURATION   = LED_DISPLAY_MS;  // Periods per posted level
+static constexpr unsigned LED_BRIGHTNESS = LED_PERIOD / 4;  // Peak duty, in ticks
+
+static_assert(STM32_TIMCLK1 % LED_TICK_HZ == 0);
+static_assert(LED_BRIGHTNESS < LED_PERIOD);
+
+static const ioline_t ledLines[LED_COUNT] = {
+    LINE_LED0, LINE_LED1, LINE_LED2, LINE_LED3, LINE_LED4,
+    LINE_LED5, LINE_LED6, LINE_LED7, LINE_LED8, LINE_LED9
+};
+
+// Only touched by ledPost() while the timer is stopped, or by the interrupt
+static struct {
+    LedPattern pattern;
+    unsigned level;
+    unsigned period;  // PWM periods played so far
+    bool lit;
+    ioline_t line;
+} led;
+
+static void ledOff()
+{
+    if (led.lit) {
+        palSetLine(led.line); // LEDs are active-low
+        led.lit = false;
+    }
+}
+
+// Called at the start of each PWM period: picks this period's LED and duty,
+// or stops the timer once the pattern has finished.
+static void ledStep()
+{
+    ledOff();
+
+    if (led.period >= LED_DURATION) {
+        TIM14->CR1 = 0;
+        TIM14->DIER = 0;
+        return;
+    }
+
+    unsigned duty;
+    if (led.pattern == LedPattern::Bar) {
+        led.line = ledLines[led.period % (led.level + 1)];
+        duty = LED_BRIGHTNESS;
+    } else {
+        // Triangle envelope over the display time
+        constexpr unsigned half = LED_DURATION / 2;
+        const auto t = led.period < half ? led.period : LED_DURATION - led.period;
+        led.line = ledLines[led.level];
+        duty = LED_BRIGHTNESS * t / half;
+    }
+    led.period++;
+
+#if defined(LEQ_LINK)
+    // LPUART1 has these pins (see link.h)
+    if (led.line == LINE_LED5 || led.line == LINE_LED6)
+        duty = 0;
+#endif
+
+    if (duty > 0) {
+        TIM14->CCR1 = duty;
+        palClearLine(led.line);
+        led.lit = true;
+    }
+}
+
+OSAL_IRQ_HANDLER(STM32_TIM14_HANDLER)
+{
+    OSAL_IRQ_PROLOGUE();
+
+    const auto sr = TIM14->SR;
+    TIM14->SR = ~sr;
+
+    // A match and the next update can arrive together at high duty
+    if (sr & TIM_SR_CC1IF)
+        ledOff();
+    if (sr & TIM_SR_UIF)
+        ledStep();
+
+    OSAL_IRQ_EPILOGUE();
+}
+
+void ledInit()
+{
+    rccEnableTIM14(true);
+    TIM14->PSC = STM32_TIMCLK1 / LED_TICK_HZ - 1;
+    TIM14->ARR = LED_PERIOD - 1;
+    TIM14->EGR = TIM_EGR_UG; // Load the prescaler
+    TIM14->SR = 0;
+    nvicEnableVector(STM32_TIM14_NUMBER, STM32_IRQ_TIM14_PRIORITY);
+}
+
+void ledPost(unsigned level, LedPattern pattern)
+{
+    // Stop any pattern still playing, then start over from the first period
+    TIM14->CR1 = 0;
+    TIM14->DIER = 0;
+    TIM14->SR = 0;
+    ledOff();
+
+    led.pattern = pattern;
+    led.level = std::min(level, LED_COUNT - 1);
+    led.period = 0;
+    ledStep();
+
+    TIM14->CNT = 0;
+    TIM14->DIER = TIM_DIER_UIE | TIM_DIER_CC1IE;
+    TIM14->CR1 = TIM_CR1_CEN;
+}
+
+// True while a pattern is playing. TIM14 stops in stop mode, so wait for
+// this before entering it.
+bool ledBusy()
+{
+    return TIM14->CR1 & TIM_CR1_CEN;
+}
+
@@ -0,0 +1,58 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LED_H
+#define LED_H
+
+// Background LED display driven by TIM14: ledPost() starts a pattern and
+// returns at once, and the timer interrupt plays it out with PWM dimming.
+
+#include <algorithm>
+#include <array>
+
+// Lower dB bound of LED1 through LED9; LED0 covers everything below 45 dB.
+// These are LAeq levels as read since every filtered sample is counted, so
+// 10 dB steps cover quiet rooms to speech, and 5 dB steps from 82 dB span
+// the 85 dB(A) hearing-risk level up to where sound becomes painful.
+static constexpr std::array<int, 9> LED_THRESHOLDS = {
+    45, 55, 65, 75, 82, 87, 92, 97, 102
+};
+static constexpr unsigned LED_COUNT = LED_THRESHOLDS.size() + 1;
+
+// How long each posted level is shown
+static constexpr unsigned LED_DISPLAY_MS = 100;
+
+// LED index for a reading in dB
+constexpr unsigned ledLevel(int db)
+{
+    return std::upper_bound(LED_THRESHOLDS.begin(), LED_THRESHOLDS.end(), db) -
+        LED_THRESHOLDS.begin();
+}
+
+static_assert(std::ranges::is_sorted(LED_THRESHOLDS));
+static_assert(ledLevel(44) == 0 && ledLevel(45) == 1 && ledLevel(102) == LED_COUNT - 1);
+
+enum class LedPattern {
+    Pulse,  // The level's LED fades in and back out
+    Bar,    // LEDs 0 through the level, scanned one at a time
+};
+
+void ledInit();
+void ledPost(unsigned level, LedPattern pattern);
+bool ledBusy();
+
+#endif // LED_H
+
@@ -0,0 +1,289 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LEQ_H
+#define LEQ_H
+
+// Sample conversion and Leq accumulation shared by the firmware's I2S
+// callback and the host tools in host/. Defines the chain's state, so only
+// main.cpp includes it in the firmware; other units take leqconfig.h.
+
+#include "energy.h"
+#include "leqconfig.h"
+#include "sos-iir-filter.h"
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+
+// Calculate reference amplitude value at compile time
+static const auto MIC_REF_AMPL = sos_t(((1 << (MIC_BITS - 1)) - 1) << SAMPLE_SHIFT) *
+    qfp_fpow(10.f, MIC_SENSITIVITY / 20.f);
+
+// Builds the filter for design F. A float design with a numerator whose
+// zeros sit exactly at DC or Nyquist, such as C's, is unrolled as
+// SOS_IIR_Static, so that those numerators take adds instead of multiplies
+// without a choice being made per sample. SOS_UNROLLED unrolls them all, and
+// fixed-point filters are always unrolled, for their constant shifts.
+template<const auto& F>
+constexpr auto leqFilter()
+{
+#if defined(SOS_UNROLLED) || defined(SOS_FIXED_POINT)
+    return SOS_IIR_Static<F, sample_t> {};
+#else
+    if constexpr (std::is_same_v<sample_t, sos_t> && sos_has_zeros(F))
+        return SOS_IIR_Static<F> {};
+    else
+        return sos_filter_cast<sample_t>(F);
+#endif
+}
+
+// The chain's filters, from the designs in leqconfig.h
+static constinit auto MIC_FILTER = leqFilter<MIC_DESIGN>();
+static constinit auto A_FILTER = leqFilter<A_DESIGN>();
+static constinit auto C_FILTER = leqFilter<C_DESIGN>();
+static constinit auto Z_FILTER = leqFilter<Z_DESIGN>();
+
+#if defined(SOS_FIXED_POINT)
+// Each block's sum of squares is taken in one 64-bit integer
+static_assert(I2S_USESIZ <= decltype(A_FILTER)::max_block,
+    "I2S_FRAMES too large for the fixed-point sums of squares");
+#endif
+
+// Compensated, so that a reading can span hours without losing blocks to
+// rounding
+static std::array<Energy, LEQ_WEIGHTINGS> Leq_sum_sqr {};
+static unsigned Leq_samples = 0;
+
+// A-weighted energy with Fast (125 ms) exponential time weighting, stepped
+// once per callback period, and its peak since last cleared. Both are per
+// block sums, so Leq_to_dB(Leq_fast_max, I2S_USESIZ) gives LAFmax.
+static constexpr float LEQ_FAST_ALPHA = [] {
+    // 1 - exp(-T/tau), by its (1,1) Pade approximant
+    constexpr float x = float(I2S_FRAMES) / float(SAMPLE_RATE) / 0.125f;
+    return x / (1.f + x / 2.f);
+}();
+static_assert(LEQ_FAST_ALPHA > 0.f && LEQ_FAST_ALPHA < 0.5f);
+
+static sos_t Leq_fast {};
+static sos_t Leq_fast_max {};
+
+// Sign-extends microphone M's sample from a DMA word. The I2S peripheral
+// reads each 32-bit slot as two half-words, most significant first.
+template<typename M = Mic>
+RAMFUNC
+inline int32_t fixsample(uint32_t s) {
+    return (int32_t)(((s & 0xFFFF) << 16) | (s >> 16)) >> (32 - M::bits);
+}
+
+// Converts an integer sample, already scaled by SAMPLE_SHIFT
+RAMFUNC
+inline sample_t tosample(int32_t s) {
+#if defined(SOS_UNPACKED)
+    return sos_u_from_int(s);
+#else
+    if constexpr (std::is_same_v<sample_t, sos_t>)
+        return sample_t(qfp_int2float_asm(s));
+    else
+        return s;
+#endif
+}
+
+// The equalizer's DC blocker on integers, with a Q31 pole. The fraction
+// that each output drops is carried into the next (error feedback), so the
+// rounding noise is shaped away from DC as in the fixed-point backend's
+// shaped sections. Inputs stay within 2^24 and outputs within 2^25.
+struct Leq_dc_blocker {
+    static constexpr int32_t A1 = [] {
+        if constexpr (MIC_DC_BLOCKER)
+            return int32_t(double(float(MIC_EQUALIZER.sos[0].a1)) * 2147483648. + .5);
+        else
+            return 0;
+    }();
+
+    int32_t x1 = 0;
+    int32_t y1 = 0;
+    uint32_t e = 0;
+
+    int32_t operator()(int32_t x) {
+        const int64_t acc = (int64_t(x - x1) << 31) + sos_smull(A1, y1) + e;
+        x1 = x;
+        y1 = int32_t(acc >> 31);
+        e = uint32_t(acc) & 0x7FFFFFFF;
+        return y1;
+    }
+};
+
+// Turns DMA words into samples in one pass: each used frame's word is read
+// once, its half-words swapped and sign-extended (fixsample()), scaled by
+// SAMPLE_SHIFT, run through the DC blocker if the equalizer has one, and
+// converted once to sample_t. Holds the DC blocker's state.
+struct Leq_ingest {
+    Leq_dc_blocker dc;
+
+    // fixsample() output at the filters' scale
+    RAMFUNC
+    static int32_t scaled(uint32_t word) {
+        return fixsample(word) * (int32_t(1) << SAMPLE_SHIFT);
+    }
+
+    RAMFUNC
+    sample_t operator()(uint32_t word) {
+        auto s = scaled(word);
+        if constexpr (MIC_DC_BLOCKER)
+            s = dc(s);
+        return tosample(s);
+    }
+
+    // Converts the I2S_USESIZ frames at `source` to `out`
+    RAMFUNC
+    void operator()(const uint32_t *source, sample_t *out) {
+        for (unsigned i = 0; i < I2S_USESIZ; i++)
+            out[i] = (*this)(source[i * 2 + Mic::slot]);
+    }
+
+    // As above, also copying each sample to `raw` before the DC blocker, so
+    // that the microphone's own offset can be seen
+    RAMFUNC
+    void operator()(const uint32_t *source, sample_t *out, sample_t *raw) {
+        for (unsigned i = 0; i < I2S_USESIZ; i++) {
+            auto s = scaled(source[i * 2 + Mic::slot]);
+            raw[i] = tosample(s);
+            if constexpr (MIC_DC_BLOCKER)
+                s = dc(s);
+            out[i] = tosample(s);
+        }
+    }
+};
+
+static Leq_ingest Leq_input {};
+
+// The block that Leq_accumulate() filters, in place
+static std::array<sample_t, I2S_USESIZ> Leq_block;
+
+// Stages of Leq_accumulate(), in order, for profiling
+enum Leq_stage : unsigned {
+    LEQ_CONVERT,   // I2S words to samples, by Leq_ingest
+    LEQ_EQUALIZE,  // Microphone equalizer
+    LEQ_WEIGHT_A,  // Each weighting, squared and summed
+    LEQ_WEIGHT_C,
+    LEQ_WEIGHT_Z,
+    LEQ_STAGES
+};
+
+struct Leq_no_mark {
+    void operator()(Leq_stage) const {}
+};
+
+// Copies the samples at `tap` to `out`, which holds I2S_USESIZ of them
+struct Leq_capture {
+    static constexpr bool enabled = true;
+    sample_t *out;
+    Leq_tap tap;
+
+    sample_t *target(Leq_tap t) const {
+        return t == tap ? out : nullptr;
+    }
+};
+
+struct Leq_no_capture {
+    static constexpr bool enabled = false;
+
+    sample_t *target(Leq_tap) const {
+        return nullptr;
+    }
+};
+
+// Filters one half of the I2S buffer (stereo frames, Mic::slot used) and
+// adds it to the A-, C- and Z-weighted Leq sums and to Leq_fast. `source`
+// is only read, by Leq_ingest, before anything else; the samples are
+// filtered in Leq_block. `mark` is called as each stage completes, and
+// `capture` may ask for a copy of the block at one tap.
+// Returns true once LEQ_PERIOD samples have been accumulated.
+template<typename Mark = Leq_no_mark, typename Capture = Leq_no_capture>
+RAMFUNC
+inline bool Leq_accumulate(const uint32_t *source, Mark mark = {}, Capture capture = {})
+{
+    const auto samples = Leq_block.data();
+    if (auto raw = capture.target(LEQ_TAP_RAW))
+        Leq_input(source, samples, raw);
+    else
+        Leq_input(source, samples);
+    auto samps = std::views::counted(samples, I2S_USESIZ);
+    mark(LEQ_CONVERT);
+
+    auto weigh = [&samps, &capture](auto& filter, Leq_tap tap) {
+        if constexpr (Capture::enabled) {
+            if (auto out = capture.target(tap))
+                return filter.sum_sqr_of(samps, [&out](sample_t s) { *out++ = s; });
+        }
+        return filter.sum_sqr_of(samps);
+    };
+
+    // Equalize once, then accumulate each weighting's Leq sum
+    MIC_FILTER.filter(samps);
+    if (auto out = capture.target(LEQ_TAP_EQUALIZED))
+        std::copy_n(samples, I2S_USESIZ, out);
+    mark(LEQ_EQUALIZE);
+    const auto a = weigh(A_FILTER, LEQ_TAP_A);
+    Leq_sum_sqr[LEQ_A] += a;
+    Leq_fast += (a - Leq_fast) * LEQ_FAST_ALPHA;
+    // Non-negative floats order the same as their bit patterns, which saves
+    // a soft-float compare
+    if (std::bit_cast<uint32_t>(float(Leq_fast)) > std::bit_cast<uint32_t>(float(Leq_fast_max)))
+        Leq_fast_max = Leq_fast;
+    mark(LEQ_WEIGHT_A);
+    Leq_sum_sqr[LEQ_C] += weigh(C_FILTER, LEQ_TAP_C);
+    mark(LEQ_WEIGHT_C);
+    Leq_sum_sqr[LEQ_Z] += weigh(Z_FILTER, LEQ_TAP_Z);
+    mark(LEQ_WEIGHT_Z);
+    Leq_samples += I2S_USESIZ;
+
+    return Leq_samples >= LEQ_PERIOD;
+}
+
+// The reading for a mean square of one: MIC_REF_DB less the reference
+// amplitude in dB, plus the unit's offset. Folding these into one value
+// leaves a log and an add per reading.
+inline sos_t Leq_reference(sos_t offset_db)
+{
+    return MIC_REF_DB + offset_db - sos_t(20.f) * qfp_flog10(MIC_REF_AMPL);
+}
+
+// Per-unit sensitivity correction in dB, added to every reading
+static sos_t Leq_offset_dB = MIC_OFFSET_DB;
+static sos_t Leq_ref_dB = Leq_reference(MIC_OFFSET_DB);
+
+inline void Leq_calibrate(sos_t offset_db)
+{
+    Leq_offset_dB = offset_db;
+    Leq_ref_dB = Leq_reference(offset_db);
+}
+
+// Converts accumulated sums to a dB reading.
+inline sos_t Leq_to_dB(sos_t sum_sqr, unsigned count)
+{
+    return Leq_ref_dB + sos_t(10.f) * qfp_flog10(sum_sqr / qfp_uint2float(count));
+}
+
+inline sos_t Leq_to_dB(const Energy& sum_sqr, unsigned count)
+{
+    return Leq_to_dB(sum_sqr.value(), count);
+}
+
+#endif // LEQ_H
+
@@ -0,0 +1,204 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LEQCONFIG_H
+#define LEQCONFIG_H
+
+// Compile-time configuration of the Leq chain: sample type, rates, I2S
+// geometry, filter designs and capture taps. Holds no state, so any
+// translation unit may include it; leq.h adds the chain itself.
+
+#include "mic.h"
+#include "schedule.h"
+#include "sos-iir-filter.h"
+
+#include <array>
+#include <cstdint>
+
+// Define SOS_FIXED_POINT to filter with integer samples instead of qfplib floats,
+// or SOS_UNPACKED for the mantissa/exponent kernel of sos-unpacked.s
+#if defined(SOS_FIXED_POINT) && defined(SOS_UNPACKED)
+#error "SOS_FIXED_POINT and SOS_UNPACKED are exclusive"
+#elif defined(SOS_FIXED_POINT)
+using sample_t = int32_t;
+#elif defined(SOS_UNPACKED)
+#if defined(LEQ_CAPTURE)
+#error "LEQ_CAPTURE sends 32-bit samples; SOS_UNPACKED samples are 64-bit"
+#endif
+using sample_t = sos_u;
+#else
+using sample_t = sos_t;
+#endif
+
+// Define SOS_UNROLLED to build the float filters as SOS_IIR_Static, with
+// every section unrolled around compile-time coefficients
+#if defined(SOS_UNROLLED) && (defined(SOS_FIXED_POINT) || defined(SOS_UNPACKED))
+#error "SOS_UNROLLED applies to the float backend only"
+#endif
+
+// Samples enter the filters with full scale at 2^24. This leaves headroom
+// for the cascade's ~32 dB peak gain, and fraction bits for the integer DC
+// blocker in Leq_ingest.
+static constexpr unsigned SAMPLE_SHIFT = 25 - Mic::bits;
+
+static constexpr auto  SAMPLE_RATE     = 48000u;
+
+// A-weighting designed for SAMPLE_RATE at compile time; at 48 kHz the
+// curve-fitted table is used instead, as it tracks IEC 61672 more closely
+// above 8 kHz.
+static constexpr auto WEIGHTING_A = []{
+  if constexpr (SAMPLE_RATE == 48000)
+    return A_weighting;
+  else
+    return sos_weighting<Weighting::A, SAMPLE_RATE>();
+}();
+static_assert(sos_stable(WEIGHTING_A));
+static_assert(sos_magnitude(WEIGHTING_A, 1000, SAMPLE_RATE) > 0.9988 &&
+              sos_magnitude(WEIGHTING_A, 1000, SAMPLE_RATE) < 1.0012);
+
+static constexpr auto WEIGHTING_C = sos_weighting<Weighting::C, SAMPLE_RATE>();
+static constexpr auto WEIGHTING_Z = sos_weighting<Weighting::Z, SAMPLE_RATE>();
+
+// The microphone chosen in mic.h
+static constexpr auto& MIC_EQUALIZER   = Mic::equalizer;
+static constexpr sos_t MIC_OFFSET_DB   (  0.f); // Offset until the unit is calibrated
+static constexpr sos_t MIC_SENSITIVITY = Mic::sensitivity; // dBFS value expected at MIC_REF_DB
+static constexpr sos_t MIC_REF_DB      = Mic::ref_db;
+static constexpr sos_t MIC_OVERLOAD_DB = Mic::overload_db;
+static constexpr sos_t MIC_NOISE_DB    = Mic::noise_db;
+static constexpr auto  MIC_BITS        = Mic::bits;
+static_assert(Mic::equalizer_rate == SAMPLE_RATE, "equalizer designed for another rate");
+
+// DMA ring geometry. The callback runs once every `frames` stereo frames and
+// filters `used` of them.
+//
+// When every frame is used, the ring holds two periods and the DMA half- and
+// full-transfer interrupts run the callback on each half in turn. Otherwise
+// the ring only holds two windows of `used` frames, DMA runs without
+// interrupts, and a TIM2 compare interrupt filters the latest complete
+// window from the ring once per period. Either way RAM is spent only on frames that are
+// filtered, and the interrupt rate is set by `frames` alone.
+struct I2s_geometry {
+    unsigned frames;
+    unsigned used;
+
+    constexpr bool windowed() const {
+        return used < frames;
+    }
+
+    // 32-bit words in the DMA ring: two halves of stereo frames
+    constexpr unsigned ring_words() const {
+        return 2 * 2 * used;
+    }
+
+    // Ring plus the block of samples that the callback filters
+    constexpr unsigned ram_bytes() const {
+        return ring_words() * sizeof(uint32_t) + used * sizeof(sample_t);
+    }
+
+    // Callbacks per second at sample rate `fs`
+    constexpr float irq_hz(unsigned fs) const {
+        return float(fs) / float(frames);
+    }
+};
+
+// Define LEQ_FULL_COVERAGE to filter every frame instead of a 16-frame window
+// from each period. Leq_samples counts filtered samples either way, so both
+// modes read the same on stationary sound. LEQ_I2S_FRAMES overrides the
+// period: shorter periods cost interrupts, and with full coverage save RAM.
+#if defined(LEQ_I2S_FRAMES)
+static constexpr unsigned I2S_FRAMES = LEQ_I2S_FRAMES;
+#else
+static constexpr unsigned I2S_FRAMES = 256;
+#endif
+#if defined(LEQ_FULL_COVERAGE)
+static constexpr I2s_geometry I2S_GEOMETRY = { I2S_FRAMES, I2S_FRAMES };
+#else
+static constexpr I2s_geometry I2S_GEOMETRY = { I2S_FRAMES, 16 };
+static_assert(I2S_GEOMETRY.windowed(), "use LEQ_FULL_COVERAGE for periods this short");
+#endif
+static constexpr unsigned I2S_USESIZ = I2S_GEOMETRY.used;
+
+static_assert(I2S_GEOMETRY.used > 0 && I2S_GEOMETRY.used <= I2S_GEOMETRY.frames);
+static_assert(I2S_GEOMETRY.ring_words() <= 65535, "DMA transfer count is 16 bits");
+
+// Callback periods needed to cover `ms` of audio
+constexpr unsigned i2sHalvesFor(unsigned ms)
+{
+    return ((ms * SAMPLE_RATE + 999) / 1000 + I2S_FRAMES - 1) / I2S_FRAMES;
+}
+
+static constexpr unsigned MIC_WARMUP_HALVES = i2sHalvesFor(MIC_WARMUP_MS);
+static constexpr unsigned LEQ_SETTLE_HALVES = i2sHalvesFor(LEQ_SETTLE_MS);
+
+// Filtered samples per reading: half a second, or one burst when duty cycling
+static constexpr unsigned LEQ_PERIOD = i2sHalvesFor(LEQ_SCHEDULE.burst_ms) * I2S_USESIZ;
+
+// Index of each weighting's sum in Leq_sum_sqr
+enum Leq_weighting : unsigned { LEQ_A, LEQ_C, LEQ_Z, LEQ_WEIGHTINGS };
+
+// True if the equalizer starts with a first-order DC blocker,
+// y = x - x1 + a1 * y1, which Leq_ingest runs on integers instead
+static constexpr bool MIC_DC_BLOCKER = [] {
+    const auto& s = MIC_EQUALIZER.sos[0];
+    return float(s.b1) == -1.f && float(s.b2) == 0.f && float(s.a2) == 0.f &&
+        float(s.a1) > 0.f && float(s.a1) < 1.f;
+}();
+
+// Numerators this close to a zero pair at DC or Nyquist are set to it
+// exactly (sos_snap_zeros()), so that they run without multiplies. This
+// only absorbs float rounding: the curve-fitted A-weighting's first zero
+// pair is 3e-4 away from DC on purpose, and moving it costs 4 dB at 10 Hz.
+// zeros-check measures what a tolerance costs.
+static constexpr double LEQ_ZEROS_TOLERANCE = 1e-6;
+
+// The equalizer runs once over each block, in place. Each weighting then
+// reads the equalized block without modifying it, carrying the equalizer's
+// gain in its own. The A and C sections are re-paired so that no section
+// output strays far from its input level.
+static constexpr auto MIC_DESIGN = sos_snap_zeros(SOS_IIR_Filter(sos_t(1.f),
+    sos_tail<MIC_DC_BLOCKER ? 1 : 0>(MIC_EQUALIZER).sos), LEQ_ZEROS_TOLERANCE, SAMPLE_RATE);
+static constexpr auto A_DESIGN = sos_scaled(sos_snap_zeros(sos_cascade<WEIGHTING_A>(),
+    LEQ_ZEROS_TOLERANCE, SAMPLE_RATE), MIC_EQUALIZER.gain);
+static constexpr auto C_DESIGN = sos_scaled(sos_snap_zeros(sos_cascade<WEIGHTING_C>(),
+    LEQ_ZEROS_TOLERANCE, SAMPLE_RATE), MIC_EQUALIZER.gain);
+static constexpr auto Z_DESIGN = sos_scaled(WEIGHTING_Z, MIC_EQUALIZER.gain);
+
+// Points in the chain where Leq_accumulate() can copy out a block
+enum Leq_tap : unsigned {
+    LEQ_TAP_RAW,        // fixsample() output, before the DC blocker
+    LEQ_TAP_EQUALIZED,  // After the microphone equalizer
+    LEQ_TAP_A,          // After each weighting
+    LEQ_TAP_C,
+    LEQ_TAP_Z,
+    LEQ_TAPS
+};
+
+// Multiplies a tapped sample so that 1.0 is the microphone's full scale.
+// Filters leave their gain to the end of the chain, so each tap's scale
+// includes the gain still to come.
+static constexpr std::array<float, LEQ_TAPS> LEQ_TAP_SCALE = [] {
+    constexpr double full = double(1u << (MIC_BITS - 1 + SAMPLE_SHIFT));
+    return std::array<float, LEQ_TAPS> {
+        float(1 / full),
+        float(float(MIC_EQUALIZER.gain) / full),
+        float(float(A_DESIGN.gain) / full),
+        float(float(C_DESIGN.gain) / full),
+        float(float(Z_DESIGN.gain) / full),
+    };
+}();
+
+#endif // LEQCONFIG_H
@@ -0,0 +1,401 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#if defined(LEQ_LINK)
+
+#include "hal.h"
+#include "leqconfig.h"
+#include "link.h"
+#include "linkframe.h"
+#include "logger.h"
+#include "sos-iir-filter.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <span>
+
+#if defined(LEQ_CAPTURE)
+static constexpr unsigned LINK_RATE = LINK_CAPTURE_BAUD;
+#else
+static constexpr unsigned LINK_RATE = LINK_BAUD;
+#endif
+
+static constexpr uint32_t LINK_BRR =
+    (uint64_t(256) * STM32_LPUART1CLK + LINK_RATE / 2) / LINK_RATE;
+static_assert(LINK_BRR >= 0x300 && LINK_BRR < (1u << 20), "LPUART1 cannot make LINK_RATE");
+static_assert(STM32_LPUART1CLK >= 3 * LINK_RATE, "LPUART1 needs 3x oversampling");
+
+static constexpr uint32_t LINK_DMA_MODE =
+    STM32_DMA_CR_DIR_M2P | STM32_DMA_CR_MINC | STM32_DMA_CR_PSIZE_BYTE |
+    STM32_DMA_CR_MSIZE_BYTE | STM32_DMA_CR_TCIE | STM32_DMA_CR_PL(0);
+
+static constexpr unsigned LINK_QUEUE = 4; // Frames
+
+// A frame as sent: `head` holds the header and any short payload, followed
+// by the CRC unless there is a `body`. A body is sent in place after the
+// head, then `crc`.
+struct Link_frame {
+    std::array<uint8_t, LINK_HEADER_BYTES + sizeof(Link_levels) + LINK_CRC_BYTES> head;
+    uint8_t head_size;
+    const uint8_t *body;
+    uint16_t body_size;
+    std::array<uint8_t, LINK_CRC_BYTES> crc;
+};
+
+// Frames are added by the main loop and retired by the DMA interrupt, each
+// side only advancing its own count
+static std::array<Link_frame, LINK_QUEUE> linkQueue;
+static volatile unsigned linkQueued;
+static volatile unsigned linkSent;
+static unsigned linkPart;   // Part of the oldest frame being sent
+static volatile bool linkActive;
+
+static volatile bool linkDumpRequested;
+static volatile bool linkDumpQueued;
+
+static const stm32_dma_stream_t *linkDma;
+static Link_parser<4> linkParser;
+
+// Link health, for inspection with a debugger
+static volatile struct {
+    uint32_t frames;    // Sent since power-up
+    uint32_t dropped;   // Not queued because the queue was full
+    uint32_t skipped;   // Capture blocks dropped for want of a free buffer
+} linkStatus;
+
+#if defined(LEQ_CAPTURE)
+static_assert(unsigned(LINK_TAP_RAW) == LEQ_TAP_RAW && unsigned(LINK_TAP_EQUALIZED) == LEQ_TAP_EQUALIZED &&
+              unsigned(LINK_TAP_A) == LEQ_TAP_A && unsigned(LINK_TAP_C) == LEQ_TAP_C &&
+              unsigned(LINK_TAP_Z) == LEQ_TAP_Z && unsigned(LINK_TAPS) == LEQ_TAPS);
+static_assert(sizeof(sample_t) == sizeof(uint32_t));
+
+enum Link_slot_state : uint8_t {
+    LINK_SLOT_FREE,
+    LINK_SLOT_FILLING,  // By the I2S callback
+    LINK_SLOT_READY,
+    LINK_SLOT_SENDING,  // By DMA
+};
+
+// A capture frame laid out as sent, so that one DMA transfer covers it
+struct Link_capture_slot {
+    uint8_t pad[3];
+    std::array<uint8_t, LINK_HEADER_BYTES> header;
+    Link_capture info;
+    std::array<uint32_t, I2S_USESIZ> samples;
+    std::array<uint8_t, LINK_CRC_BYTES> crc;
+    volatile Link_slot_state state;
+
+    const uint8_t *frame() const {
+        return header.data();
+    }
+
+    static constexpr unsigned frame_size() {
+        return offsetof(Link_capture_slot, crc) + LINK_CRC_BYTES -
+               offsetof(Link_capture_slot, header);
+    }
+};
+static_assert(offsetof(Link_capture_slot, info) ==
+                  offsetof(Link_capture_slot, header) + LINK_HEADER_BYTES &&
+              offsetof(Link_capture_slot, samples) ==
+                  offsetof(Link_capture_slot, info) + sizeof(Link_capture) &&
+              offsetof(Link_capture_slot, crc) ==
+                  offsetof(Link_capture_slot, samples) + sizeof(uint32_t) * I2S_USESIZ,
+              "capture frames must be contiguous");
+
+// Slots move from free to ready in the I2S callback, and back to free in
+// the link interrupts, each side only writing the states it moves from
+static std::array<Link_capture_slot, 2> linkSlots;
+static Link_capture_slot *linkFilling;
+static Link_capture_slot *linkSending;
+
+// Set by the receive interrupt, and counted down by the I2S callback
+static volatile unsigned linkCaptureLeft;
+static volatile uint8_t linkCaptureTap;
+static volatile uint8_t linkCaptureEvery;
+static volatile uint32_t linkCaptureBlock;
+
+// The oldest block waiting to be sent
+static Link_capture_slot *linkCaptureReady()
+{
+    Link_capture_slot *oldest = nullptr;
+    for (auto& slot : linkSlots) {
+        if (slot.state == LINK_SLOT_READY && (!oldest || slot.info.block < oldest->info.block))
+            oldest = &slot;
+    }
+    return oldest;
+}
+#endif
+
+static void linkTransmit(const void *data, unsigned size)
+{
+    dmaStreamDisable(linkDma);
+    dmaStreamSetMemory0(linkDma, data);
+    dmaStreamSetTransactionSize(linkDma, size);
+    dmaStreamSetMode(linkDma, LINK_DMA_MODE);
+    dmaStreamEnable(linkDma);
+    linkActive = true;
+}
+
+// Sends the next part of the oldest frame, retiring frames as they finish.
+// Runs from the DMA interrupt, or with interrupts masked.
+static void linkNext()
+{
+#if defined(LEQ_CAPTURE)
+    if (linkSending) {
+        linkSending->state = LINK_SLOT_FREE;
+        linkSending = nullptr;
+        linkStatus.frames = linkStatus.frames + 1;
+    }
+#endif
+
+    while (linkSent != linkQueued) {
+        const auto& f = linkQueue[linkSent % LINK_QUEUE];
+        const auto part = linkPart++;
+
+        if (part == 0) {
+            linkTransmit(f.head.data(), f.head_size);
+            return;
+        } else if (f.body && part == 1) {
+            linkTransmit(f.body, f.body_size);
+            return;
+        } else if (f.body && part == 2) {
+            linkTransmit(f.crc.data(), f.crc.size());
+            return;
+        }
+
+        // Requests that came in while the log was going out are answered
+        if (f.body) {
+            linkDumpRequested = false;
+            linkDumpQueued = false;
+        }
+        linkPart = 0;
+        linkSent = linkSent + 1;
+        linkStatus.frames = linkStatus.frames + 1;
+    }
+
+#if defined(LEQ_CAPTURE)
+    // Capture blocks go out when nothing else is waiting. Their CRC is left
+    // to here to keep it out of the I2S callback.
+    if (auto slot = linkCaptureReady()) {
+        const auto length = uint16_t(sizeof(Link_capture) + slot->info.count * sizeof(uint32_t));
+        const auto crc = crc16(reinterpret_cast<const uint8_t *>(&slot->info), length,
+                               linkCrc(LINK_CAPTURE, length));
+        slot->header = linkHeader(LINK_CAPTURE, length);
+        slot->crc = { uint8_t(crc), uint8_t(crc >> 8) };
+        slot->state = LINK_SLOT_SENDING;
+        linkSending = slot;
+        linkTransmit(slot->frame(), slot->frame_size());
+        return;
+    }
+#endif
+
+    // Interrupt once the last byte has left, to wake a linkBusy() wait
+    linkActive = false;
+    LPUART1->CR1 |= USART_CR1_TCIE;
+}
+
+static void linkDmaDone(void *, uint32_t flags)
+{
+    if (flags & STM32_DMA_ISR_TCIF)
+        linkNext();
+}
+
+// Queues a frame of `data`, which is copied, then `body`, which is sent in
+// place and so must not change until the frame is sent
+static bool linkPush(Link_type type, std::span<const uint8_t> data,
+                     std::span<const uint8_t> body = {})
+{
+    if (linkQueued - linkSent >= LINK_QUEUE) {
+        linkStatus.dropped = linkStatus.dropped + 1;
+        return false;
+    }
+
+    auto& f = linkQueue[linkQueued % LINK_QUEUE];
+    const auto length = uint16_t(data.size() + body.size());
+    auto crc = crc16(data.data(), data.size(), linkCrc(type, length));
+    crc = crc16(body.data(), body.size(), crc);
+
+    const auto header = linkHeader(type, length);
+    auto end = std::copy(header.begin(), header.end(), f.head.begin());
+    end = std::copy(data.begin(), data.end(), end);
+    f.crc = { uint8_t(crc), uint8_t(crc >> 8) };
+    if (body.empty()) {
+        end = std::copy(f.crc.begin(), f.crc.end(), end);
+        f.body = nullptr;
+    } else {
+        f.body = body.data();
+        f.body_size = uint16_t(body.size());
+    }
+    f.head_size = uint8_t(end - f.head.begin());
+
+    osalSysLock();
+    linkQueued = linkQueued + 1;
+    if (!linkActive)
+        linkNext();
+    osalSysUnlock();
+    return true;
+}
+
+// Acts on a frame from the host
+static void linkReceived()
+{
+    switch (linkParser.type()) {
+    case LINK_DUMP_REQUEST:
+        linkDumpRequested = true;
+        break;
+#if defined(LEQ_CAPTURE)
+    case LINK_CAPTURE_REQUEST:
+        if (Link_capture_request r; linkParser.payload().size() == sizeof(r)) {
+            std::memcpy(&r, linkParser.payload().data(), sizeof(r));
+            if (r.tap < LINK_TAPS) {
+                // The I2S callback can run at any point here
+                linkCaptureLeft = 0;
+                linkCaptureTap = r.tap;
+                linkCaptureEvery = std::max<uint8_t>(r.every, 1);
+                linkCaptureBlock = 0;
+                linkCaptureLeft = r.blocks;
+            }
+        }
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+// LPUART1 has the G0 line's shared USART3/USART4/LPUART1 vector to itself
+// here. linkCaptureEnd() also pends it to start sending.
+OSAL_IRQ_HANDLER(STM32_USART3_4_LP1_HANDLER)
+{
+    OSAL_IRQ_PROLOGUE();
+
+    const auto isr = LPUART1->ISR;
+    if (isr & USART_ISR_TC)
+        LPUART1->CR1 &= ~USART_CR1_TCIE;
+    if (isr & (USART_ISR_ORE | USART_ISR_FE | USART_ISR_NE))
+        LPUART1->ICR = USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NECF;
+    if (isr & USART_ISR_RXNE_RXFNE) {
+        if (linkParser.feed(uint8_t(LPUART1->RDR)))
+            linkReceived();
+    }
+
+#if defined(LEQ_CAPTURE)
+    if (!linkActive && linkCaptureReady())
+        linkNext();
+#endif
+
+    OSAL_IRQ_EPILOGUE();
+}
+
+void linkInit()
+{
+    palSetLineMode(LINE_LINK_TX, PAL_MODE_ALTERNATE(6));
+    palSetLineMode(LINE_LINK_RX, PAL_MODE_ALTERNATE(6) | PAL_STM32_PUPDR_PULLUP);
+
+    rccEnableLPUART1(true);
+    LPUART1->BRR = LINK_BRR;
+    LPUART1->CR3 = USART_CR3_DMAT;
+    LPUART1->CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE | USART_CR1_RXNEIE_RXFNEIE;
+
+    osalSysLock();
+    linkDma = dmaStreamAllocI(STM32_DMA_STREAM_ID_ANY, STM32_IRQ_LPUART1_PRIORITY,
+                              linkDmaDone, nullptr);
+    osalSysUnlock();
+    osalDbgAssert(linkDma != nullptr, "no DMA channel for LPUART1");
+    dmaSetRequestSource(linkDma, STM32_DMAMUX1_LPUART1_TX);
+    dmaStreamSetPeripheral(linkDma, &LPUART1->TDR);
+
+    nvicEnableVector(STM32_USART3_4_LP1_NUMBER, STM32_IRQ_LPUART1_PRIORITY);
+}
+
+void linkSendLevels(uint32_t reading, float laeq, float lceq, float lzeq, float lafmax)
+{
+    auto centi = [](float db) {
+        return int16_t(std::clamp(qfp_float2int(sos_t(db) * 100.f + 0.5f), -32768, 32767));
+    };
+    const Link_levels levels { reading, centi(laeq), centi(lceq), centi(lzeq), centi(lafmax) };
+    linkPush(LINK_LEVELS, { reinterpret_cast<const uint8_t *>(&levels), sizeof(levels) });
+}
+
+void linkService()
+{
+    if (!linkDumpRequested || linkDumpQueued)
+        return;
+
+    // Computing the CRC over the region takes about 30 ms. If the queue is
+    // full, the dump is tried again after the next reading.
+    const auto log = logRegion();
+    linkDumpQueued = true;
+    if (linkPush(LINK_LOG, {}, { reinterpret_cast<const uint8_t *>(log.data()), log.size_bytes() }))
+        linkDumpRequested = false;
+    else
+        linkDumpQueued = false;
+}
+
+bool linkDumping()
+{
+    return linkDumpQueued;
+}
+
+bool linkBusy()
+{
+    return linkActive || !(LPUART1->ISR & USART_ISR_TC);
+}
+
+#if defined(LEQ_CAPTURE)
+RAMFUNC
+uint32_t *linkCaptureBegin(unsigned& tap)
+{
+    if (linkCaptureLeft == 0)
+        return nullptr;
+
+    const auto block = linkCaptureBlock;
+    linkCaptureBlock = block + 1;
+    if (block % linkCaptureEvery != 0)
+        return nullptr;
+
+    for (auto& slot : linkSlots) {
+        if (slot.state == LINK_SLOT_FREE) {
+            slot.state = LINK_SLOT_FILLING;
+            slot.info.block = block;
+            slot.info.tap = linkCaptureTap;
+            linkFilling = &slot;
+            tap = slot.info.tap;
+            return slot.samples.data();
+        }
+    }
+
+    linkStatus.skipped = linkStatus.skipped + 1;
+    return nullptr;
+}
+
+RAMFUNC
+void linkCaptureEnd()
+{
+    auto& slot = *linkFilling;
+    slot.info.rate = SAMPLE_RATE;
+    slot.info.scale = LEQ_TAP_SCALE[slot.info.tap];
+    slot.info.format = std::is_same_v<sample_t, sos_t> ? LINK_PCM_FLOAT32 : LINK_PCM_INT32;
+    slot.info.count = I2S_USESIZ;
+    slot.state = LINK_SLOT_READY;
+    linkCaptureLeft = linkCaptureLeft - 1;
+    NVIC_SetPendingIRQ(IRQn_Type(STM32_USART3_4_LP1_NUMBER));
+}
+#endif
+
+#endif // LEQ_LINK
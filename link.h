@@ -0,0 +1,63 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LINK_H
+#define LINK_H
+
+// Binary data link on LPUART1 (build with LEQ_LINK), framed as described in
+// linkframe.h. Each reading is sent as a LINK_LEVELS frame, and a
+// LINK_DUMP_REQUEST from the host is answered with the flash log.
+//
+// Transmission is by DMA from a small queue of frames filled by the main
+// loop, so nothing here waits on the UART, and the I2S callback outranks
+// both of its interrupts. The log is sent straight out of flash. LPUART1's
+// only pins on this package are PA2 and PA3, so LED5 and LED6 stay dark.
+//
+// Nothing is received in STOP1, so with LEQ_DUTY_CYCLE a request sent
+// between bursts is lost, and the host should repeat it.
+//
+// With LEQ_CAPTURE as well, the link runs at LINK_CAPTURE_BAUD and the host
+// can ask for blocks of samples from a point in the filter chain. The I2S
+// callback fills one of two buffers, which a low-priority interrupt then
+// sends. A block that finds both buffers busy is dropped whole.
+
+#include <cstdint>
+
+#if defined(LEQ_CAPTURE) && !defined(LEQ_LINK)
+#error "LEQ_CAPTURE needs LEQ_LINK"
+#endif
+
+void linkInit();
+// Queues a reading in dB. Dropped if the queue is full.
+void linkSendLevels(uint32_t reading, float laeq, float lceq, float lzeq, float lafmax);
+// Starts a log dump if one was requested
+void linkService();
+// True while the log is being sent; it must not be written meanwhile
+bool linkDumping();
+// True until everything queued has left the UART. LPUART1 is clocked from
+// PCLK, which stops in stop mode, so wait for this before entering it.
+bool linkBusy();
+
+#if defined(LEQ_CAPTURE)
+// For the I2S callback: where this block's samples go, and from which
+// Leq_tap, or nullptr if the block is not wanted or there is no room
+uint32_t *linkCaptureBegin(unsigned& tap);
+// Sends the block filled since linkCaptureBegin()
+void linkCaptureEnd();
+#endif
+
+#endif // LINK_H
+
@@ -0,0 +1,199 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LINKFRAME_H
+#define LINKFRAME_H
+
+// Framing for the LPUART1 data link (link.h), shared by the firmware and the
+// host reader. Every frame is
+//
+//   0xA5 0x5A   sync
+//   u16         payload length, little-endian
+//   u8          type
+//   payload
+//   u16         crc16() of the length, type and payload, little-endian
+//
+// A receiver that loses its place, or sees a bad CRC, hunts for the next
+// sync. Multi-byte payload fields are little-endian too.
+
+#include "crc.h"
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+static constexpr unsigned LINK_BAUD         = 115200;
+static constexpr unsigned LINK_CAPTURE_BAUD = 921600;  // Builds with LEQ_CAPTURE
+static constexpr uint8_t  LINK_SYNC0        = 0xA5;
+static constexpr uint8_t  LINK_SYNC1        = 0x5A;
+static constexpr unsigned LINK_HEADER_BYTES = 5;
+static constexpr unsigned LINK_CRC_BYTES    = 2;
+
+enum Link_type : uint8_t {
+    LINK_LEVELS          = 0x01, // Card: a Link_levels after each reading
+    LINK_LOG             = 0x02, // Card: the whole flash log region, as logdump reads it
+    LINK_CAPTURE         = 0x03, // Card: a Link_capture, then its samples
+    LINK_DUMP_REQUEST    = 0x81, // Host: asks for a LINK_LOG frame, no payload
+    LINK_CAPTURE_REQUEST = 0x82, // Host: a Link_capture_request
+};
+
+// One reading, levels in 0.01 dB steps
+struct Link_levels {
+    uint32_t reading;   // Counts up from 1 at power-up
+    int16_t laeq;
+    int16_t lceq;
+    int16_t lzeq;
+    int16_t lafmax;     // Loudest Fast A level during the reading
+};
+static_assert(sizeof(Link_levels) == 12);
+
+// Points in the filter chain that can be captured
+enum Link_tap : uint8_t {
+    LINK_TAP_RAW,       // Microphone samples as received
+    LINK_TAP_EQUALIZED, // After the microphone equalizer
+    LINK_TAP_A,         // After each weighting
+    LINK_TAP_C,
+    LINK_TAP_Z,
+    LINK_TAPS
+};
+
+enum Link_pcm : uint8_t {
+    LINK_PCM_INT32,
+    LINK_PCM_FLOAT32,
+};
+
+// Asks for `blocks` callback blocks from `tap`, taking one in every `every`.
+// Zero blocks stops a capture in progress.
+struct Link_capture_request {
+    uint8_t tap;
+    uint8_t every;
+    uint16_t blocks;
+};
+static_assert(sizeof(Link_capture_request) == 4);
+
+// Starts the payload of a LINK_CAPTURE frame: one callback's block of
+// samples. Blocks that found the card's buffers full are dropped whole,
+// which shows as a gap in `block`.
+struct Link_capture {
+    uint32_t block;     // Callback periods since the capture was requested
+    uint32_t rate;      // Sample rate in Hz
+    float scale;        // Multiplies samples so that 1.0 is the microphone's full scale
+    uint8_t tap;        // Link_tap
+    uint8_t format;     // Link_pcm
+    uint16_t count;     // Samples that follow
+};
+static_assert(sizeof(Link_capture) == 16);
+
+// crc16() of a frame's length and type, to be continued over its payload
+constexpr uint16_t linkCrc(Link_type type, uint16_t length)
+{
+    const uint8_t b[3] = { uint8_t(length), uint8_t(length >> 8), type };
+    return crc16(b, sizeof(b));
+}
+
+constexpr std::array<uint8_t, LINK_HEADER_BYTES> linkHeader(Link_type type, uint16_t length)
+{
+    return { LINK_SYNC0, LINK_SYNC1, uint8_t(length), uint8_t(length >> 8), type };
+}
+
+// Reassembles frames one byte at a time, dropping any with a payload longer
+// than N bytes
+template<std::size_t N>
+class Link_parser {
+    enum State { Sync0, Sync1, Length0, Length1, Type, Payload, Crc0, Crc1 };
+
+    std::array<uint8_t, N> buffer;
+    State state = Sync0;
+    uint16_t length = 0;
+    uint16_t received = 0;
+    uint16_t crc = 0;
+    Link_type kind {};
+
+public:
+    unsigned errors = 0;   // Frames dropped for their length or CRC
+
+    // Returns true when `b` completes a valid frame
+    constexpr bool feed(uint8_t b) {
+        switch (state) {
+        case Sync0:
+            state = b == LINK_SYNC0 ? Sync1 : Sync0;
+            break;
+        case Sync1:
+            state = b == LINK_SYNC1 ? Length0 : b == LINK_SYNC0 ? Sync1 : Sync0;
+            break;
+        case Length0:
+            length = b;
+            state = Length1;
+            break;
+        case Length1:
+            length |= uint16_t(b << 8);
+            if (length > N) {
+                errors++;
+                state = Sync0;
+            } else {
+                state = Type;
+            }
+            break;
+        case Type:
+            kind = Link_type(b);
+            received = 0;
+            state = length > 0 ? Payload : Crc0;
+            break;
+        case Payload:
+            buffer[received++] = b;
+            if (received == length)
+                state = Crc0;
+            break;
+        case Crc0:
+            crc = b;
+            state = Crc1;
+            break;
+        case Crc1:
+            crc |= uint16_t(b << 8);
+            state = Sync0;
+            if (crc == crc16(buffer.data(), length, linkCrc(kind, length)))
+                return true;
+            errors++;
+            break;
+        }
+        return false;
+    }
+
+    // The last frame completed
+    constexpr Link_type type() const {
+        return kind;
+    }
+
+    constexpr std::span<const uint8_t> payload() const {
+        return std::span(buffer).first(length);
+    }
+};
+
+static_assert([] {
+    // A dump request round trip
+    const auto h = linkHeader(LINK_DUMP_REQUEST, 0);
+    const auto crc = linkCrc(LINK_DUMP_REQUEST, 0);
+    Link_parser<4> p;
+    bool done = false;
+    for (auto b : h)
+        done |= p.feed(b);
+    done |= p.feed(uint8_t(crc));
+    done |= p.feed(uint8_t(crc >> 8));
+    return done && p.type() == LINK_DUMP_REQUEST && p.payload().empty();
+}());
+
+#endif // LINKFRAME_H
+
@@ -0,0 +1,317 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LOGCODEC_H
+#define LOGCODEC_H
+
+// Leq log format, shared by the firmware's logger and the host decoder.
+//
+// The log region is a ring of flash pages. Each page starts with a
+// Log_page_header and holds a series of blocks, each made of payload double
+// words followed by a Log_trailer. Blocks never span pages, and the trailer
+// is written last, so a block cut short by a power loss has no valid trailer
+// and is skipped. Every page's first block is a session block, so each page
+// can be decoded on its own once older pages have been overwritten.
+//
+// A reading block holds up to LOG_BLOCK_LEVELS levels in 0.1 dB steps: 60
+// readings of LAeq, LCeq and LZeq, or 180 of LAeq alone, as the latest
+// session block gives. Its payload is a bit stream, packed from the least
+// significant bit of each double word up:
+//
+//   k[c]        LOG_RICE_K_BITS  per channel: Rice parameter for its deltas
+//   level[0][c] LOG_LEVEL_BITS   per channel: the keyframe
+//   then for each later reading, for each channel, the zigzagged difference
+//   from the previous reading z as Rice code: z >> k in unary (ones ended by
+//   a zero) and the low k bits of z; or, when z >> k would reach
+//   LOG_ESCAPE, LOG_ESCAPE ones followed by z in LOG_DELTA_BITS.
+//
+// The escape bounds every code, so encoding takes bounded time and space.
+
+#include "flash.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <span>
+
+static constexpr uint32_t LOG_MAGIC       = 0x4C51'454C; // "LEQL" in memory
+static constexpr uint16_t LOG_BLOCK_MAGIC = 0xB10C;
+static constexpr unsigned LOG_PAGE_SLOTS  = FLASH_PAGE_BYTES / sizeof(uint64_t);
+
+static constexpr unsigned LOG_CHANNELS    = 3;   // LAeq, LCeq, LZeq
+static constexpr unsigned LOG_BATCH       = 60;  // Readings per block of all channels
+static constexpr unsigned LOG_BLOCK_LEVELS = LOG_BATCH * LOG_CHANNELS;
+static constexpr unsigned LOG_LEVEL_BITS  = 12;  // 0.1 dB steps up to 409.5 dB
+static constexpr unsigned LOG_DELTA_BITS  = LOG_LEVEL_BITS + 1;
+static constexpr unsigned LOG_RICE_K_BITS = 4;
+static constexpr unsigned LOG_ESCAPE      = 15;
+
+static constexpr uint16_t LOG_LEVEL_MAX   = (1u << LOG_LEVEL_BITS) - 1;
+
+static constexpr uint16_t LOG_POWER_UP    = 1;   // Log_session flag
+
+// Readings per block when each holds `channels` levels
+constexpr unsigned logBatch(unsigned channels)
+{
+    return LOG_BLOCK_LEVELS / channels;
+}
+
+struct Log_page_header {
+    uint32_t magic;
+    uint32_t sequence;  // Counts up from 1 with each page started
+};
+
+// Payload of a session block (count zero): starts each page, and marks each
+// power-up, after which readings restart with no known time in between
+struct Log_session {
+    uint32_t period_ms; // Time between readings
+    uint16_t flags;
+    uint16_t channels;  // Levels per reading: LAeq, then LCeq and LZeq if 3
+};
+
+struct Log_trailer {
+    uint16_t magic;
+    uint8_t count;      // Readings in the block, or zero for a session block
+    uint8_t words;      // Payload double words before the trailer
+    uint16_t crc;       // crc16() of the payload
+    uint16_t check;     // crc16() of the fields above
+
+    static constexpr uint16_t checkOf(const Log_trailer& t) {
+        const uint8_t b[6] = { uint8_t(t.magic), uint8_t(t.magic >> 8), t.count, t.words,
+                               uint8_t(t.crc), uint8_t(t.crc >> 8) };
+        return crc16(b, sizeof(b));
+    }
+
+    static constexpr Log_trailer make(unsigned count, unsigned words, uint16_t crc) {
+        Log_trailer t { LOG_BLOCK_MAGIC, uint8_t(count), uint8_t(words), crc, 0 };
+        t.check = checkOf(t);
+        return t;
+    }
+
+    constexpr bool valid() const {
+        return magic == LOG_BLOCK_MAGIC && check == checkOf(*this);
+    }
+};
+
+static_assert(sizeof(Log_page_header) == 8 && sizeof(Log_session) == 8 &&
+              sizeof(Log_trailer) == 8);
+static_assert(!std::bit_cast<Log_trailer>(FLASH_ERASED).valid());
+
+// crc16() of a run of double words, as they sit in (little-endian) memory
+constexpr uint16_t logCrc(uint64_t word, uint16_t crc)
+{
+    uint8_t b[8];
+    for (unsigned i = 0; i < 8; i++)
+        b[i] = uint8_t(word >> (i * 8));
+    return crc16(b, sizeof(b), crc);
+}
+
+// Clamps a level in 0.1 dB steps to what a block can hold
+constexpr uint16_t logQuantize(int decibels_x10)
+{
+    return uint16_t(std::clamp<int>(decibels_x10, 0, LOG_LEVEL_MAX));
+}
+
+constexpr uint32_t logZigzag(int d)
+{
+    return d < 0 ? uint32_t(-d) * 2 - 1 : uint32_t(d) * 2;
+}
+
+constexpr int logUnzigzag(uint32_t z)
+{
+    return z & 1 ? -int((z + 1) / 2) : int(z / 2);
+}
+
+constexpr unsigned logCodeBits(uint32_t z, unsigned k)
+{
+    const auto q = z >> k;
+    return q < LOG_ESCAPE ? q + 1 + k : LOG_ESCAPE + LOG_DELTA_BITS;
+}
+
+// Largest payload a block of `count` readings can need, in double words
+constexpr unsigned logMaxWords(unsigned count, unsigned channels)
+{
+    const unsigned bits = channels * (LOG_RICE_K_BITS + LOG_LEVEL_BITS +
+        (count - 1) * (LOG_ESCAPE + LOG_DELTA_BITS));
+    return (bits + 63) / 64;
+}
+
+// Whether a full block, after a header and session block, fits in a page
+constexpr bool logBatchFits(unsigned channels)
+{
+    const auto words = logMaxWords(logBatch(channels), channels);
+    return logBatch(channels) <= 255 && words <= 255 && words + 1 + 2 + 1 <= LOG_PAGE_SLOTS;
+}
+
+static_assert(logBatchFits(1) && logBatchFits(LOG_CHANNELS));
+static_assert(LOG_LEVEL_BITS < (1u << LOG_RICE_K_BITS));
+
+// Rice parameters for a block and its exact size
+struct Log_plan {
+    unsigned channels = 0;
+    std::array<uint8_t, LOG_CHANNELS> k {};
+    unsigned bits = 0;
+
+    constexpr unsigned words() const {
+        return (bits + 63) / 64;
+    }
+};
+
+// Picks the cheapest Rice parameter for each channel's deltas. `in` holds
+// whole readings of `channels` levels each, one reading after another.
+constexpr Log_plan logPlan(std::span<const uint16_t> in, unsigned channels)
+{
+    Log_plan plan;
+    plan.channels = channels;
+    plan.bits = channels * (LOG_RICE_K_BITS + LOG_LEVEL_BITS);
+
+    for (unsigned c = 0; c < channels; c++) {
+        unsigned best = ~0u;
+        for (unsigned k = 0; k <= LOG_LEVEL_BITS; k++) {
+            unsigned bits = 0;
+            for (unsigned i = c + channels; i < in.size(); i += channels)
+                bits += logCodeBits(logZigzag(in[i] - in[i - channels]), k);
+            if (bits < best) {
+                best = bits;
+                plan.k[c] = uint8_t(k);
+            }
+        }
+        plan.bits += best;
+    }
+
+    return plan;
+}
+
+// Packs bits into double words, handing each to `sink` once full
+template<typename Sink>
+class Log_bit_writer {
+    Sink& sink;
+    uint64_t word = 0;
+    unsigned used = 0;
+
+public:
+    constexpr explicit Log_bit_writer(Sink& s): sink(s) {}
+
+    constexpr void put(uint32_t value, unsigned bits) {
+        while (bits > 0) {
+            const auto n = std::min(bits, 64 - used);
+            word |= uint64_t(value & ((uint64_t(1) << n) - 1)) << used;
+            value = n < 32 ? value >> n : 0;
+            bits -= n;
+            used += n;
+            if (used == 64) {
+                sink(word);
+                word = 0;
+                used = 0;
+            }
+        }
+    }
+
+    constexpr void flush() {
+        if (used > 0)
+            sink(word);
+        word = 0;
+        used = 0;
+    }
+};
+
+// Encodes a block planned by logPlan(), calling `sink` with each of its
+// plan.words() double words in turn
+template<typename Sink>
+constexpr void logEncode(std::span<const uint16_t> in, const Log_plan& plan, Sink&& sink)
+{
+    const auto channels = plan.channels;
+    Log_bit_writer w (sink);
+
+    for (unsigned c = 0; c < channels; c++)
+        w.put(plan.k[c], LOG_RICE_K_BITS);
+    for (unsigned c = 0; c < channels; c++)
+        w.put(in[c], LOG_LEVEL_BITS);
+
+    for (unsigned i = channels; i < in.size(); i += channels) {
+        for (unsigned c = 0; c < channels; c++) {
+            const auto z = logZigzag(in[i + c] - in[i + c - channels]);
+            const auto k = plan.k[c];
+            const auto q = z >> k;
+            if (q < LOG_ESCAPE) {
+                w.put((1u << q) - 1, q + 1);  // Ones, then the terminating zero
+                w.put(z, k);
+            } else {
+                w.put((1u << LOG_ESCAPE) - 1, LOG_ESCAPE);
+                w.put(z, LOG_DELTA_BITS);
+            }
+        }
+    }
+
+    w.flush();
+}
+
+class Log_bit_reader {
+    std::span<const uint64_t> in;
+    unsigned pos = 0;
+
+public:
+    constexpr explicit Log_bit_reader(std::span<const uint64_t> words): in(words) {}
+
+    constexpr bool overrun() const {
+        return pos > in.size() * 64;
+    }
+
+    constexpr uint32_t get(unsigned bits) {
+        uint32_t value = 0;
+        for (unsigned i = 0; i < bits; i++, pos++) {
+            if (pos < in.size() * 64)
+                value |= uint32_t((in[pos / 64] >> (pos % 64)) & 1) << i;
+        }
+        return value;
+    }
+};
+
+// Decodes a reading block's payload into `out`, whole readings of
+// `channels` levels each. Returns false if the payload is malformed.
+constexpr bool logDecode(std::span<const uint64_t> payload, std::span<uint16_t> out,
+                         unsigned channels)
+{
+    Log_bit_reader r (payload);
+    std::array<unsigned, LOG_CHANNELS> k;
+
+    for (unsigned c = 0; c < channels; c++) {
+        k[c] = r.get(LOG_RICE_K_BITS);
+        if (k[c] > LOG_LEVEL_BITS)
+            return false;
+    }
+    for (unsigned c = 0; c < channels; c++)
+        out[c] = uint16_t(r.get(LOG_LEVEL_BITS));
+
+    for (unsigned i = channels; i < out.size(); i += channels) {
+        for (unsigned c = 0; c < channels; c++) {
+            unsigned q = 0;
+            while (q < LOG_ESCAPE && r.get(1))
+                q++;
+            const auto z = q < LOG_ESCAPE ? (q << k[c]) | r.get(k[c]) : r.get(LOG_DELTA_BITS);
+            const int level = out[i + c - channels] + logUnzigzag(z);
+            if (level < 0 || level > LOG_LEVEL_MAX)
+                return false;
+            out[i + c] = uint16_t(level);
+        }
+    }
+
+    return !r.overrun();
+}
+
+#endif // LOGCODEC_H
+
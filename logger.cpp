@@ -0,0 +1,167 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "flash.h"
+#include "logcodec.h"
+#include "logger.h"
+#include "sos-iir-filter.h"
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <span>
+
+// Log region from the linker script, in double words
+extern "C" const uint64_t __log_base__[], __log_end__[];
+
+// Where the next double word goes: slot 0 of each page is its header
+static const uint64_t *logPage;
+static unsigned logSlot;
+static uint32_t logSequence;
+
+static Log_session logSession;
+
+// Whole readings, one after another, as logEncode() takes them
+static std::array<uint16_t, logBatch(LOG_STORED_CHANNELS) * LOG_STORED_CHANNELS> logStage;
+static unsigned logStaged;  // Levels, not readings
+
+// Log health, for inspection with a debugger
+static volatile struct {
+    uint32_t readings;  // Written since power-up
+    uint32_t words;     // Double words written since power-up
+    uint32_t dropped;   // Not staged because the stage was full
+    uint32_t errors;    // Failed erases and writes
+} logStatus;
+
+static void logWrite(uint64_t word)
+{
+    // A failed write still uses its slot; its block will fail its check
+    if (!flashProgram(logPage + logSlot, word))
+        logStatus.errors = logStatus.errors + 1;
+    logSlot++;
+    logStatus.words = logStatus.words + 1;
+}
+
+static void logWriteSession()
+{
+    const auto payload = std::bit_cast<uint64_t>(logSession);
+    logWrite(payload);
+    logWrite(std::bit_cast<uint64_t>(Log_trailer::make(0, 1, logCrc(payload, 0xFFFF))));
+    logSession.flags &= ~LOG_POWER_UP;
+}
+
+// Starts the page after the current one, erasing whatever it held
+static void logAdvance()
+{
+    auto next = logPage + LOG_PAGE_SLOTS;
+    if (next >= __log_end__)
+        next = __log_base__;
+
+    if (!flashErase(next))
+        logStatus.errors = logStatus.errors + 1;
+
+    logPage = next;
+    logSlot = 0;
+    logWrite(std::bit_cast<uint64_t>(Log_page_header { LOG_MAGIC, ++logSequence }));
+    logWriteSession();
+}
+
+// Makes room for `words` more double words, moving to the next page if needed
+static void logReserve(unsigned words)
+{
+    if (logSlot + words > LOG_PAGE_SLOTS)
+        logAdvance();
+}
+
+void logInit(uint32_t period_ms)
+{
+    // The page with the latest valid header is the one being filled. Pages
+    // whose header is torn or blank are next in line to be erased anyway.
+    logPage = nullptr;
+    for (auto page = __log_base__; page < __log_end__; page += LOG_PAGE_SLOTS) {
+        flashEccFault = false;
+        Log_page_header h;
+        std::memcpy(&h, page, sizeof(h));
+
+        if (!flashEccFault && h.magic == LOG_MAGIC && (!logPage || h.sequence > logSequence)) {
+            logPage = page;
+            logSequence = h.sequence;
+        }
+    }
+    flashEccFault = false;
+
+    if (logPage) {
+        // Resume after the last double word programmed, even if it is torn
+        logSlot = LOG_PAGE_SLOTS;
+        while (logSlot > 1 && logPage[logSlot - 1] == FLASH_ERASED)
+            logSlot--;
+    } else {
+        // Empty log: the first write starts the first page
+        logPage = __log_end__ - LOG_PAGE_SLOTS;
+        logSlot = LOG_PAGE_SLOTS;
+        logSequence = 0;
+    }
+    flashEccFault = false;
+
+    logSession = { period_ms, LOG_POWER_UP, LOG_STORED_CHANNELS };
+    logStaged = 0;
+}
+
+void logAppend(float laeq, float lceq, float lzeq)
+{
+    if (logStaged >= logStage.size()) {
+        logStatus.dropped = logStatus.dropped + 1;
+        return;
+    }
+
+    const float levels[LOG_CHANNELS] = { laeq, lceq, lzeq };
+    for (unsigned c = 0; c < LOG_STORED_CHANNELS; c++)
+        logStage[logStaged++] = logQuantize(qfp_float2int(sos_t(levels[c]) * 10.f + 0.5f));
+}
+
+void logService()
+{
+    if (logStaged < logStage.size())
+        return;
+
+    // Mark the power-up, unless starting a new page does so anyway
+    if (logSession.flags & LOG_POWER_UP) {
+        logReserve(2);
+        if (logSession.flags & LOG_POWER_UP)
+            logWriteSession();
+    }
+
+    const auto block = std::span<const uint16_t>(logStage);
+    const auto plan = logPlan(block, LOG_STORED_CHANNELS);
+    logReserve(plan.words() + 1);
+
+    uint16_t crc = 0xFFFF;
+    logEncode(block, plan, [&crc](uint64_t word) {
+        crc = logCrc(word, crc);
+        logWrite(word);
+    });
+    const auto count = logStaged / LOG_STORED_CHANNELS;
+    logWrite(std::bit_cast<uint64_t>(Log_trailer::make(count, plan.words(), crc)));
+
+    logStatus.readings = logStatus.readings + count;
+    logStaged = 0;
+}
+
+std::span<const uint64_t> logRegion()
+{
+    return { __log_base__, __log_end__ };
+}
+
@@ -0,0 +1,58 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LOGGER_H
+#define LOGGER_H
+
+// Leq log in the internal flash region reserved by the linker script, in the
+// format described in logcodec.h.
+//
+// Pages are written in turn as a ring, the oldest page being erased when the
+// log wraps, so every page wears at the same rate. Blocks end with a trailer
+// written after their payload, so a power loss can only spoil the block
+// being written: it then lacks a valid trailer (or fails ECC) and is
+// skipped, and the log carries on after it.
+//
+// Readings are staged in RAM and encoded as a full block by logService(),
+// which the main loop calls while the I2S callback has nothing to do. The
+// staged readings are lost if power drops first.
+
+#include "logcodec.h"
+
+#include <cstdint>
+#include <span>
+
+// Levels logged per reading. LEQ_LOG_LAEQ logs LAeq alone, which fits three
+// times the readings in a block and in the ring.
+#if defined(LEQ_LOG_LAEQ)
+static constexpr unsigned LOG_STORED_CHANNELS = 1;
+#else
+static constexpr unsigned LOG_STORED_CHANNELS = LOG_CHANNELS;
+#endif
+
+// Finds where the log left off and starts a new session
+void logInit(uint32_t period_ms);
+// Stages one reading in dB; LCeq and LZeq are ignored with LEQ_LOG_LAEQ.
+// Dropped if the stage is full.
+void logAppend(float laeq, float lceq = 0.f, float lzeq = 0.f);
+// Encodes and writes the staged block once it is full. Takes bounded time,
+// but may stall flash access for an erase and up to 83 double-word writes.
+void logService();
+// The whole log region, as dumped for logdump
+std::span<const uint64_t> logRegion();
+
+#endif // LOGGER_H
+
@@ -14,69 +14,167 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include "calibration.h"
 #include "hal.h"
-#include "sos-iir-filter.h"
+#include "led.h"
+#include "leq.h"
+#include "link.h"
+#include "logger.h"
+#include "profile.h"
 
 #include <algorithm>
 #include <atomic>
 #include <array>
 #include <cstring>
-#include <ranges>
+#include <utility>
 
-static constexpr auto& WEIGHTING       = A_weighting;
-static constexpr auto& MIC_EQUALIZER   = SPH0645LM4H_B_RB;
-static constexpr sos_t MIC_OFFSET_DB   (  0.f); // Linear offset
-static constexpr sos_t MIC_SENSITIVITY (-26.f); // dBFS value expected at MIC_REF_DB
-static constexpr sos_t MIC_REF_DB      ( 94.f); // dB where sensitivity is specified
-static constexpr sos_t MIC_OVERLOAD_DB (120.f); // dB - Acoustic overload point
-static constexpr sos_t MIC_NOISE_DB    ( 29.f); // dB - Noise floor
-static constexpr auto  MIC_BITS        = 18u;
-static constexpr auto  SAMPLE_RATE     = 48000u;
+static constexpr auto LED_PATTERN = LedPattern::Pulse;
 
-static constexpr unsigned I2S_BUFSIZ = 1024;
-static constexpr unsigned I2S_USESIZ = 16;
+// Every LED must be reachable above the microphone's noise and below overload
+static_assert(LED_THRESHOLDS.front() > float(MIC_NOISE_DB) + 10 &&
+              LED_THRESHOLDS.back() < float(MIC_OVERLOAD_DB));
 
-// Calculate reference amplitude value at compile time
-static const auto MIC_REF_AMPL = sos_t((1 << (MIC_BITS - 1)) - 1) *
-    qfp_fpow(10.f, MIC_SENSITIVITY / 20.f);
+// scheduleCurrent() split into fixed and load-dependent parts, so that the
+// firmware only needs one multiply and add at runtime
+static constexpr float SCHEDULE_BASE_UA = scheduleCurrent(LEQ_SCHEDULE, 0);
+static constexpr float SCHEDULE_LOAD_UA = scheduleCurrent(LEQ_SCHEDULE, 1) - SCHEDULE_BASE_UA;
+
+#if defined(LEQ_DUTY_CYCLE)
+static_assert(LEQ_SCHEDULE.active_ms() + LED_DISPLAY_MS < LEQ_SCHEDULE.period_ms);
+static_assert(LEQ_SCHEDULE.period_ms < 65536, "LPTIM1 counts to 65535 ms");
+#endif
 
 static std::atomic_bool i2sReady;
-static std::array<uint32_t, I2S_BUFSIZ> i2sBuffer;
-static sos_t Leq_sum_sqr (0.f);
-static unsigned Leq_samples = 0;
+static std::array<uint32_t, I2S_GEOMETRY.ring_words()> i2sBuffer;
+
+// i2sProcess processing time in TIM2 ticks, for inspection with a debugger.
+// `budget` is the time between callbacks.
+static volatile struct {
+    uint32_t last;
+    uint32_t max;
+    uint32_t budget;
+    uint32_t overruns;
+} i2sLoad;
+
+#if defined(LEQ_PROFILE)
+// Per-stage i2sCallback timing in TIM2 ticks, for inspection with a debugger.
+// Not static, so that the otherwise unread results are kept.
+Profile<LEQ_STAGES> i2sProfile;
+#endif
+
+// Latest LAeq, LCeq and LZeq readings in dB, indexed by Leq_weighting.
+// LCeq - LAeq indicates how much of the noise is low-frequency.
+static volatile float Leq_levels[LEQ_WEIGHTINGS];
+// Loudest Fast A-weighted level during the latest reading, in dB
+static volatile float Leq_LAFmax;
+
+#if defined(LEQ_LOG_LAEQ)
+// Readings rolled up into each logged LAeq, so that each spans at least 1 s,
+// and the A-weighted energy and sample count of those taken so far
+static constexpr unsigned LOG_ROLLUP = (1000 + LEQ_SCHEDULE.period_ms - 1) /
+    LEQ_SCHEDULE.period_ms;
+static Energy logRollSum;
+static unsigned logRollCount;
+static unsigned logRolled;
+#endif
+
+// Estimated average supply current for LEQ_SCHEDULE at the worst callback
+// load seen so far, and the number of readings taken, for a debugger.
+static volatile struct {
+    float current_uA;
+    uint32_t readings;
+} scheduleReport;
+
+// Callback periods since the I2S clock last started, counting up to
+// the end of filter settling
+static unsigned i2sHalves;
+
+// Calibration offset in force, in 0.01 dB, and the boot-time check for a
+// calibrator with the A-weighted energy it has seen so far
+static int calOffset;
+static Cal_detector calDetector;
+static Cal_state calState = Cal_state::Watching;
+static Energy calSum;
+static unsigned calCount;
 
-static void blinkDb(int db);
 static void i2sCallback(I2SDriver *i2s);
+static void i2sProcess(const uint32_t *source);
+static void i2sBegin();
+static void calWatch(const Energy& sum_sqr, unsigned count);
+#if defined(LEQ_DUTY_CYCLE)
+static void stopFor(unsigned ms);
+#endif
 
 static constexpr unsigned I2SPRval = 16'000'000 / SAMPLE_RATE / 32 / 2;
-static constexpr I2SConfig i2sConfig = {
-    /* TX buffer */ NULL,
-    /* RX buffer */ i2sBuffer.data(),
-    /* Size */      i2sBuffer.size(),
-    /* Callback */  i2sCallback,
-    /* I2SCFGR */   (3 << SPI_I2SCFGR_I2SCFG_Pos) | // Master receive
-                    (0 << SPI_I2SCFGR_I2SSTD_Pos) | // Philips I2S
-                    (1 << SPI_I2SCFGR_DATLEN_Pos) | // 24-bit
-                    SPI_I2SCFGR_CHLEN,              // 32-bit frame
-    /* I2SPR */     (I2SPRval / 2) | ((I2SPRval & 1) ? SPI_I2SPR_ODD : 0)
-};
+
+// I2S setup for microphone M
+template<typename M>
+constexpr I2SConfig i2sConfigFor()
+{
+    constexpr unsigned standard = M::format == Mic_format::Philips ? 0 : 1;
+    return {
+        /* TX buffer */ NULL,
+        /* RX buffer */ i2sBuffer.data(),
+        /* Size */      i2sBuffer.size(),
+        /* Callback */  I2S_GEOMETRY.windowed() ? NULL : i2sCallback,
+        /* I2SCFGR */   (3 << SPI_I2SCFGR_I2SCFG_Pos) |        // Master receive
+                        (standard << SPI_I2SCFGR_I2SSTD_Pos) | // Philips or MSB-justified
+                        (1 << SPI_I2SCFGR_DATLEN_Pos) |        // 24-bit
+                        SPI_I2SCFGR_CHLEN,                     // 32-bit frame
+        /* I2SPR */     (I2SPRval / 2) | ((I2SPRval & 1) ? SPI_I2SPR_ODD : 0)
+    };
+}
+
+static constexpr I2SConfig i2sConfig = i2sConfigFor<Mic>();
+
+// TIM2 ticks per callback period. Taken from the I2S clock divider (64 bit
+// clocks per frame) rather than SAMPLE_RATE, so that windowed pacing stays
+// locked to the DMA.
+static constexpr uint32_t I2S_PERIOD_TICKS =
+    uint64_t(I2S_FRAMES) * 64 * I2SPRval * STM32_TIMCLK1 / STM32_SYSCLK;
+static_assert(uint64_t(I2S_FRAMES) * 64 * I2SPRval * STM32_TIMCLK1 % STM32_SYSCLK == 0);
+
+// TIM2 ticks for half a window. The windowed compare fires this far into
+// the half of the ring that DMA is filling; a period is a whole number of
+// rings, so it stays there.
+static constexpr uint32_t I2S_PHASE_TICKS =
+    uint64_t(I2S_USESIZ / 2) * 64 * I2SPRval * STM32_TIMCLK1 / STM32_SYSCLK;
+static_assert(!I2S_GEOMETRY.windowed() || I2S_FRAMES % (2 * I2S_USESIZ) == 0);
 
 int main(void)
 {
     halInit();
     osalSysEnable();
+    ledInit();
   
-    i2sReady.store(true);
-    i2sStart(&I2SD1, &i2sConfig);
-    i2sStartExchange(&I2SD1);
-    // Microphone warmup time
-    osalThreadSleepMilliseconds(140);
-    // Reach filter delay steady state
-    i2sReady.store(false);
-    osalThreadSleepMilliseconds(120);
-    // Discard initial readings
-    Leq_sum_sqr = 0.f;
-    Leq_samples = 0;
+    // Free-running TIM2 for measuring i2sProcess load, and with CC1 for
+    // pacing windowed callbacks
+    rccEnableTIM2(true);
+    TIM2->ARR = 0xFFFFFFFF;
+    TIM2->CR1 = TIM_CR1_CEN;
+    nvicEnableVector(STM32_TIM2_NUMBER, STM32_IRQ_TIM2_PRIORITY);
+    i2sLoad.budget = I2S_PERIOD_TICKS;
+#if defined(LEQ_PROFILE)
+    i2sProfile.setBudget(i2sLoad.budget);
+    i2sProfile.cycles_per_tick = STM32_HCLK / STM32_TIMCLK1;
+#endif
+
+#if defined(LEQ_DUTY_CYCLE)
+    rccEnableLPTIM1(true);
+#endif
+
+    constexpr int nominal = int(float(MIC_OFFSET_DB) * 100);
+    calOffset = calLoad(nominal);
+    Leq_calibrate(sos_t(qfp_int2float(calOffset)) / 100.f);
+#if defined(LEQ_LOG_LAEQ)
+    logInit(LEQ_SCHEDULE.period_ms * LOG_ROLLUP);
+#else
+    logInit(LEQ_SCHEDULE.period_ms);
+#endif
+#if defined(LEQ_LINK)
+    linkInit();
+#endif
+    i2sBegin();
 
     for (;;) {
         i2sReady.store(false);
@@ -85,80 +183,235 @@ int main(void)
         __WFI();
         //palSetLine(LINE_TP1);
 
-        const auto sum_sqr = std::exchange(Leq_sum_sqr, sos_t(0.f));
+#if defined(LEQ_DUTY_CYCLE)
+        // Stopping the clock puts the microphone to sleep too
+        TIM2->DIER = 0;
+        i2sStopExchange(&I2SD1);
+        i2sStop(&I2SD1);
+#endif
+
+        const auto sum_sqr = std::exchange(Leq_sum_sqr, {});
         const auto count = std::exchange(Leq_samples, 0);
-        const sos_t Leq_RMS = qfp_fsqrt(sum_sqr / qfp_uint2float(count));
-        const sos_t Leq_dB = MIC_OFFSET_DB + MIC_REF_DB + sos_t(20.f) *
-            qfp_flog10(Leq_RMS / MIC_REF_AMPL);
-        const auto n = std::clamp(qfp_float2int(Leq_dB), 0, 999);
-        blinkDb(n);
+        for (unsigned i = 0; i < LEQ_WEIGHTINGS; i++)
+            Leq_levels[i] = Leq_to_dB(sum_sqr[i], count);
+        Leq_LAFmax = Leq_to_dB(std::exchange(Leq_fast_max, {}), I2S_USESIZ);
+        const auto n = std::clamp(qfp_float2int(Leq_levels[LEQ_A]), 0, 999);
+        ledPost(ledLevel(n), LED_PATTERN);
+
+        // Flash writes stall the CPU, so they happen now, while i2sReady
+        // has the callback ignoring audio (or I2S is stopped)
+        if (calState == Cal_state::Watching)
+            calWatch(sum_sqr[LEQ_A], count);
+#if defined(LEQ_LOG_LAEQ)
+        logRollSum += sum_sqr[LEQ_A];
+        logRollCount += count;
+        if (++logRolled == LOG_ROLLUP) {
+            logAppend(Leq_to_dB(std::exchange(logRollSum, {}), std::exchange(logRollCount, 0)));
+            logRolled = 0;
+        }
+#else
+        logAppend(Leq_levels[LEQ_A], Leq_levels[LEQ_C], Leq_levels[LEQ_Z]);
+#endif
+#if defined(LEQ_LINK)
+        // A dump is read out of flash by DMA, so hold off writing until it
+        // has gone
+        linkService();
+        if (!linkDumping())
+            logService();
+#else
+        logService();
+#endif
+
+        const auto load = sos_t(qfp_uint2float(i2sLoad.max)) / qfp_uint2float(i2sLoad.budget);
+        scheduleReport.current_uA = load * SCHEDULE_LOAD_UA + SCHEDULE_BASE_UA;
+        scheduleReport.readings = scheduleReport.readings + 1;
+
+#if defined(LEQ_LINK)
+        linkSendLevels(scheduleReport.readings, Leq_levels[LEQ_A], Leq_levels[LEQ_C],
+                       Leq_levels[LEQ_Z], Leq_LAFmax);
+#endif
+
+#if defined(LEQ_DUTY_CYCLE)
+        // TIM14 and LPUART1 do not run in stop mode, so let the display and
+        // link finish first
+#if defined(LEQ_LINK)
+        while (ledBusy() || linkBusy())
+            __WFI();
+#else
+        while (ledBusy())
+            __WFI();
+#endif
+        stopFor(LEQ_SCHEDULE.period_ms - LEQ_SCHEDULE.active_ms() - LED_DISPLAY_MS);
+        i2sBegin();
+#endif
+    }
+}
+
+// Checks each reading after power-up for a calibrator tone, and once
+// CAL_READINGS have been, recalibrates and shows a full bar
+void calWatch(const Energy& sum_sqr, unsigned count)
+{
+    auto uncorrected = [](float db) {
+        return qfp_float2int(sos_t(db) * 100.f + 0.5f) - calOffset;
+    };
+
+    calState = calDetector.feed(uncorrected(Leq_levels[LEQ_A]),
+                                uncorrected(Leq_levels[LEQ_C]),
+                                uncorrected(Leq_levels[LEQ_Z]));
+    calSum += sum_sqr;
+    calCount += count;
+    if (calState != Cal_state::Done)
+        return;
+
+    const auto offset = CAL_LEVEL - uncorrected(Leq_to_dB(calSum, calCount));
+    if (offset != calOffset) {
+        // A failed write leaves the old record in force at the next boot
+        calStore(offset);
+        calOffset = offset;
+        Leq_calibrate(sos_t(qfp_int2float(offset)) / 100.f);
     }
+    ledPost(LED_COUNT - 1, LedPattern::Bar);
 }
 
-void blinkDb(int db)
+// Starts the I2S clock and DMA. The callback skips the microphone's warmup
+// and lets the filters settle before counting samples.
+void i2sBegin()
 {
-    auto line = LINE_LED0;
-
-    if (db < 45)
-        line = LINE_LED0;
-    else if (db < 55)
-        line = LINE_LED1;
-    else if (db < 65)
-        line = LINE_LED2;
-    else if (db < 75)
-        line = LINE_LED3;
-    else if (db < 82)
-        line = LINE_LED4;
-    else if (db < 87)
-        line = LINE_LED5;
-    else if (db < 92)
-        line = LINE_LED6;
-    else if (db < 97)
-        line = LINE_LED7;
-    else if (db < 102)
-        line = LINE_LED8;
-    else
-        line = LINE_LED9;
-
-    palClearLine(line);
-    osalThreadSleepMilliseconds(100);
-    palSetLine(line);
+    i2sHalves = 0;
+    i2sStart(&I2SD1, &i2sConfig);
+
+    if constexpr (I2S_GEOMETRY.windowed()) {
+        // Keep the DMA quiet; TIM2 takes over as the callback, starting one
+        // period and half a window from now, mid-way through the first half
+        I2SD1.rxdmamode &= ~(STM32_DMA_CR_HTIE | STM32_DMA_CR_TCIE);
+        TIM2->CCR1 = TIM2->CNT + I2S_PERIOD_TICKS + I2S_PHASE_TICKS;
+        TIM2->SR = ~TIM_SR_CC1IF;
+        TIM2->DIER = TIM_DIER_CC1IE;
+    }
+
+    i2sStartExchange(&I2SD1);
 }
 
-__attribute__((section(".data")))
-int32_t fixsample(uint32_t s) {
-    return (int32_t)(((s & 0xFFFF) << 16) | (s >> 16)) >> (32 - MIC_BITS);
+#if defined(LEQ_DUTY_CYCLE)
+// Enters STOP1 for about `ms` milliseconds. LPTIM1 runs from the LSI through
+// a /32 prescaler, so it ticks at roughly 1 kHz.
+void stopFor(unsigned ms)
+{
+    LPTIM1->CR = 0;
+    LPTIM1->CFGR = 5 << LPTIM_CFGR_PRESC_Pos;
+    LPTIM1->IER = LPTIM_IER_ARRMIE; // Only writable while disabled
+    LPTIM1->CR = LPTIM_CR_ENABLE;
+    LPTIM1->ARR = ms - 1;
+    while (!(LPTIM1->ISR & LPTIM_ISR_ARROK));
+    LPTIM1->ICR = LPTIM_ICR_ARROKCF;
+    LPTIM1->CR = LPTIM_CR_ENABLE | LPTIM_CR_SNGSTRT;
+
+    // With interrupts masked, the pending LPTIM1 interrupt still ends WFI
+    // but is never taken, so no handler is needed
+    __disable_irq();
+    NVIC_EnableIRQ(LPTIM1_IRQn);
+    PWR->CR1 = (PWR->CR1 & ~PWR_CR1_LPMS) | PWR_CR1_LPMS_0;
+    SCB->SCR = (SCB->SCR & ~SCB_SCR_SLEEPONEXIT_Msk) | SCB_SCR_SLEEPDEEP_Msk;
+    while (!(LPTIM1->ISR & LPTIM_ISR_ARRM))
+        __WFI();
+    SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+
+    // Wakeup leaves SYSCLK on HSISYS, which is what mcuconf.h selects anyway
+    LPTIM1->ICR = LPTIM_ICR_ARRMCF;
+    LPTIM1->CR = 0;
+    NVIC_DisableIRQ(LPTIM1_IRQn);
+    NVIC_ClearPendingIRQ(LPTIM1_IRQn);
+    __enable_irq();
 }
+#endif
 
-__attribute__((section(".data")))
+// DMA half- and full-transfer callback when every frame is filtered
+RAMFUNC
 void i2sCallback(I2SDriver *i2s)
 {
-    if (i2sReady.load())
+    const auto halfsize = i2sBuffer.size() / 2;
+    i2sProcess(i2sBuffer.data() + (i2sIsBufferComplete(i2s) ? halfsize : 0));
+}
+
+#if !defined(LEQ_FULL_COVERAGE)
+// Windowed callback, once per I2S_FRAMES frames. It fires with DMA half a
+// window into one half of the ring, so the other holds the latest complete
+// window, and DMA reaches that half I2S_USESIZ / 2 frames (160 us at
+// 50 kHz) later. The window is filtered straight from the ring, so
+// interrupt entry and Leq_ingest's pass over it must fit in that margin. A
+// late start still finds the complete half, with that much less margin.
+RAMFUNC
+OSAL_IRQ_HANDLER(STM32_TIM2_HANDLER)
+{
+    OSAL_IRQ_PROLOGUE();
+
+    TIM2->SR = ~TIM_SR_CC1IF;
+    // Catch up by whole periods, keeping the phase, if a flash erase held
+    // this off for more than a period
+    do
+        TIM2->CCR1 = TIM2->CCR1 + I2S_PERIOD_TICKS;
+    while (int32_t(TIM2->CCR1 - TIM2->CNT) <= 0);
+
+    const auto halfsize = i2sBuffer.size() / 2;
+    const auto written = i2sBuffer.size() - dmaStreamGetTransactionSize(I2SD1.dmarx);
+    i2sProcess(i2sBuffer.data() + (written < halfsize ? halfsize : 0));
+
+    OSAL_IRQ_EPILOGUE();
+}
+#endif
+
+RAMFUNC
+void i2sProcess(const uint32_t *source)
+{
+    // Microphone output is not valid until it has warmed up
+    const auto half = i2sHalves;
+    if (half <= MIC_WARMUP_HALVES + LEQ_SETTLE_HALVES)
+        i2sHalves = half + 1;
+    if (half < MIC_WARMUP_HALVES || i2sReady.load())
         return;
 
     //palSetLine(LINE_TP1);
+    const uint32_t start = TIM2->CNT;
 
-    const auto halfsize = i2sBuffer.size() / 2;
-    const auto source = i2sBuffer.data() + (i2sIsBufferComplete(i2s) ? halfsize : 0);
-    auto samples = reinterpret_cast<sos_t *>(source);
-    std::ranges::copy(
-        std::views::counted(source, I2S_USESIZ * 2)
-            | std::ranges::views::stride(2)
-            | std::views::transform([](uint32_t s) { return sos_t(qfp_int2float_asm(fixsample(s))); }),
-        samples);
-    auto samps = std::views::counted(samples, I2S_USESIZ);
-
-    // Accumulate Leq sum
-    MIC_EQUALIZER.filter(samps);
-    Leq_sum_sqr += WEIGHTING.filter_sum_sqr(samps);
-    Leq_samples += halfsize / 2;
-
-    // Wakeup main thread for dB calculation every half second
-    if (Leq_samples >= SAMPLE_RATE / 2) {
+    // Discard what accumulated while the filters settled
+    const bool settled = half >= MIC_WARMUP_HALVES + LEQ_SETTLE_HALVES;
+    if (half == MIC_WARMUP_HALVES + LEQ_SETTLE_HALVES) {
+        Leq_sum_sqr = {};
+        Leq_samples = 0;
+        Leq_fast_max = {};
+    }
+
+#if defined(LEQ_PROFILE)
+    uint32_t marks[LEQ_STAGES];
+    const auto mark = [&marks](Leq_stage s) { marks[s] = TIM2->CNT; };
+#else
+    constexpr Leq_no_mark mark {};
+#endif
+#if defined(LEQ_CAPTURE)
+    unsigned tap = 0;
+    const auto capture = reinterpret_cast<sample_t *>(linkCaptureBegin(tap));
+    const bool ready = Leq_accumulate(source, mark, Leq_capture { capture, Leq_tap(tap) });
+    if (capture)
+        linkCaptureEnd();
+#else
+    const bool ready = Leq_accumulate(source, mark);
+#endif
+
+    // Wakeup main thread for dB calculation once a reading is complete
+    if (ready && settled) {
         i2sReady.store(true);
         SCB->SCR &= ~SCB_SCR_SLEEPONEXIT_Msk;
     }
 
+    const uint32_t ticks = TIM2->CNT - start;
+    i2sLoad.last = ticks;
+    if (ticks > i2sLoad.max)
+        i2sLoad.max = ticks;
+    if (ticks > i2sLoad.budget)
+        i2sLoad.overruns = i2sLoad.overruns + 1;
+#if defined(LEQ_PROFILE)
+    i2sProfile.record(start, marks, start + ticks);
+#endif
     //palClearLine(LINE_TP1);
 }
 
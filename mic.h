@@ -0,0 +1,98 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MIC_H
+#define MIC_H
+
+// Microphone profiles. Each one is a type that gathers what the firmware
+// needs to know about one I2S MEMS microphone: its equalizer, its datasheet
+// levels, and how its samples sit in the I2S frame. The build picks one with
+// LEQ_MIC (default Mic_sph0645), which becomes `Mic`. fixsample(), the I2S
+// configuration and the filter chain are all built from it at compile time,
+// so a variant costs nothing at run time.
+//
+// All of these send MSB-first two's complement in 32-bit channel slots,
+// which the I2S peripheral reads as 24-bit data.
+
+#include "sos-iir-filter.h"
+
+// Where the microphone's samples sit in an I2S frame
+enum class Mic_format {
+    Philips,        // First bit one clock after WS changes
+    MsbJustified    // First bit with the WS change
+};
+
+// Knowles SPH0645LM4H-B, SELECT low
+struct Mic_sph0645 {
+    static constexpr auto& equalizer   = SPH0645LM4H_B_RB;
+    static constexpr unsigned equalizer_rate = 48000;
+    static constexpr sos_t sensitivity {-26.f}; // dBFS at ref_db
+    static constexpr sos_t ref_db      { 94.f}; // dB where sensitivity is specified
+    static constexpr sos_t overload_db {120.f}; // dB - Acoustic overload point
+    static constexpr sos_t noise_db    { 29.f}; // dB - Noise floor
+    static constexpr unsigned bits     = 18;
+    static constexpr Mic_format format = Mic_format::Philips;
+    static constexpr unsigned slot     = 0;     // Left channel
+};
+
+// TDK ICS-43434, LR low
+struct Mic_ics43434 {
+    static constexpr auto& equalizer   = ICS43434;
+    static constexpr unsigned equalizer_rate = 48000;
+    static constexpr sos_t sensitivity {-26.f};
+    static constexpr sos_t ref_db      { 94.f};
+    static constexpr sos_t overload_db {120.f};
+    static constexpr sos_t noise_db    { 29.f}; // 65 dBA SNR
+    static constexpr unsigned bits     = 24;
+    static constexpr Mic_format format = Mic_format::Philips;
+    static constexpr unsigned slot     = 0;
+};
+
+// TDK INMP441, L/R low
+struct Mic_inmp441 {
+    static constexpr auto& equalizer   = INMP441;
+    static constexpr unsigned equalizer_rate = 48000;
+    static constexpr sos_t sensitivity {-26.f};
+    static constexpr sos_t ref_db      { 94.f};
+    static constexpr sos_t overload_db {120.f};
+    static constexpr sos_t noise_db    { 33.f}; // 61 dBA SNR
+    static constexpr unsigned bits     = 24;
+    static constexpr Mic_format format = Mic_format::Philips;
+    static constexpr unsigned slot     = 0;
+};
+
+// Checks a profile against what the rest of the firmware assumes
+template<typename M>
+constexpr bool mic_valid()
+{
+    const auto eq1k = sos_magnitude(M::equalizer, 1000, M::equalizer_rate);
+    return M::bits >= 16 && M::bits <= 24 && M::slot < 2 &&
+        sos_stable(M::equalizer) &&
+        eq1k > 0.97 && eq1k < 1.03;  // Within 0.25 dB, as a calibrator at 1 kHz would see
+}
+
+static_assert(mic_valid<Mic_sph0645>());
+static_assert(mic_valid<Mic_ics43434>());
+static_assert(mic_valid<Mic_inmp441>());
+
+#if defined(LEQ_MIC)
+using Mic = LEQ_MIC;
+#else
+using Mic = Mic_sph0645;
+#endif
+
+#endif // MIC_H
+
@@ -0,0 +1,102 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// Per-stage timing statistics for a periodic handler, kept in RAM so that
+// they can be read with a debugger. Times are in ticks of whatever free-
+// running counter the caller samples; only differences are used, so the
+// counter may wrap.
+
+#include <array>
+#include <cstdint>
+
+static constexpr unsigned PROFILE_BINS = 16;     // Histogram bins, see Profile::histogram
+static constexpr unsigned PROFILE_OVERRUN_LOG = 8;
+
+struct Profile_stat {
+    uint32_t min = UINT32_MAX;
+    uint32_t max = 0;
+    uint32_t count = 0;
+    uint64_t sum = 0;
+
+    void add(uint32_t ticks) {
+        if (ticks < min)
+            min = ticks;
+        if (ticks > max)
+            max = ticks;
+        count++;
+        sum += ticks;
+    }
+
+    uint32_t mean() const {
+        return count ? uint32_t(sum / count) : 0;
+    }
+};
+
+template<unsigned Stages>
+struct Profile {
+    uint32_t budget = 0;          // Ticks until the handler's deadline, see setBudget()
+    uint32_t bin_ticks = 0;       // Width of a histogram bin, budget / 8
+    uint32_t cycles_per_tick = 1; // CPU cycles per counter tick, for reference
+    uint32_t runs = 0;
+    uint32_t overruns = 0;
+
+    std::array<Profile_stat, Stages> stages {};
+    Profile_stat total {};
+
+    // Whole-handler times in sixteenths of twice the budget: bins 0-7 are
+    // within the deadline, bins 8-15 overran it (the last one by 7/8 or more).
+    std::array<uint32_t, PROFILE_BINS> histogram {};
+
+    // Run numbers of the latest overruns, oldest overwritten first
+    std::array<uint32_t, PROFILE_OVERRUN_LOG> overrun_at {};
+
+    // Sets the deadline. The bin width is worked out here so that record(),
+    // which runs in the handler, divides 32-bit rather than calling libgcc's
+    // 64-bit division from flash.
+    void setBudget(uint32_t ticks) {
+        budget = ticks;
+        bin_ticks = ticks / (PROFILE_BINS / 2);
+    }
+
+    // Records one run from its start time, each stage's end time, and its
+    // end time
+    void record(uint32_t start, const uint32_t (&marks)[Stages], uint32_t end) {
+        auto last = start;
+        for (unsigned i = 0; i < Stages; i++) {
+            stages[i].add(marks[i] - last);
+            last = marks[i];
+        }
+
+        const auto ticks = end - start;
+        total.add(ticks);
+
+        const auto bin = bin_ticks ? ticks / bin_ticks : 0;
+        histogram[bin < PROFILE_BINS ? bin : PROFILE_BINS - 1]++;
+
+        if (ticks > budget) {
+            overrun_at[overruns % PROFILE_OVERRUN_LOG] = runs;
+            overruns++;
+        }
+
+        runs++;
+    }
+};
+
+#endif // PROFILE_H
+
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2024  Clyne Sullivan <clyne@bitgloo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+// Measurement timing: how long the microphone and filters need after the I2S
+// clock starts, and how often a reading is taken. Shared by the firmware and
+// the host tools, along with a rough supply current model for comparing
+// schedules.
+
+// Time from I2S clock start until the microphone's output is valid
+static constexpr unsigned MIC_WARMUP_MS = 140;
+// Time for the filters to reach steady state before samples count
+static constexpr unsigned LEQ_SETTLE_MS = 120;
+
+struct Schedule {
+    unsigned burst_ms;   // Audio measured per reading
+    unsigned period_ms;  // Time between reading starts; equal to burst_ms when continuous
+
+    constexpr bool continuous() const {
+        return period_ms <= burst_ms;
+    }
+
+    // Time with the microphone and I2S running in each period
+    constexpr unsigned active_ms() const {
+        return continuous() ? period_ms : MIC_WARMUP_MS + LEQ_SETTLE_MS + burst_ms;
+    }
+};
+
+// Define LEQ_DUTY_CYCLE to measure in bursts, with the I2S clock and the
+// microphone stopped and the MCU in STOP1 between them. Otherwise readings
+// cover every half second back to back.
+#if defined(LEQ_DUTY_CYCLE)
+static constexpr Schedule LEQ_SCHEDULE = { 250, 2000 };
+static_assert(!LEQ_SCHEDULE.continuous() &&
+              LEQ_SCHEDULE.active_ms() <= LEQ_SCHEDULE.period_ms,
+              "burst plus warmup and settling must fit in the period");
+#else
+static constexpr Schedule LEQ_SCHEDULE = { 500, 500 };
+#endif
+
+// Typical supply currents in microamps, from the STM32G031 and SPH0645LM4H
+// datasheets (16 MHz HSI, range 2). Only good for comparing schedules;
+// measure the board for absolute figures. LEDs are not included.
+static constexpr float MCU_RUN_UA   = 1600; // Run, executing the I2S callback
+static constexpr float MCU_SLEEP_UA = 600;  // Sleep with I2S and DMA running
+static constexpr float MCU_STOP1_UA = 5;    // Stop 1 with LSI and LPTIM1
+static constexpr float MIC_ON_UA    = 600;
+static constexpr float MIC_SLEEP_UA = 10;   // With its clock stopped
+
+// Estimated average supply current for a schedule, where `load` is the
+// fraction of time spent in the I2S callback while measuring
+constexpr float scheduleCurrent(const Schedule& s, float load)
+{
+    const float active = MIC_ON_UA + MCU_SLEEP_UA + (MCU_RUN_UA - MCU_SLEEP_UA) * load;
+    const float idle = MIC_SLEEP_UA + MCU_STOP1_UA;
+    const float on = float(s.active_ms()) / float(s.period_ms);
+    return active * on + idle * (1 - on);
+}
+
+#endif // SCHEDULE_H
+
@@ -22,15 +22,27 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cstdint>
 #include <ranges>
 #include <utility>
 
 extern "C" {
+#if defined(NOISECARD_HOST)
+#include "host/qfplib-host.h"
+#else
 #include <qfplib-m0-full.h>
 #include "qfplib-port.h"
+#endif
 }
 
+// Places hot-path code in RAM on the target; no-op for host builds.
+#if defined(NOISECARD_HOST)
+#define RAMFUNC
+#else
+#define RAMFUNC __attribute__((section(".data")))
+#endif
+
 class sos_t
 {
     float v;
@@ -58,7 +70,7 @@ public:
         return (*this = *this + o);
     }
 
-    operator float() const noexcept {
+    constexpr operator float() const noexcept {
         return v;
     }
 };
@@ -75,10 +87,35 @@ struct SOS_Delay_State {
   sos_t w1;
 };
 
+// Receives each output sample of sum_sqr_of(); the default discards them
+struct sos_no_tap {
+  void operator()(auto) const {}
+};
+
+// Numerators that SOS_IIR_Static runs without multiplies: zeros exactly at
+// DC (z = 1) or Nyquist (z = -1), as bilinear-transform designs place them
+enum class SOS_zeros : uint8_t {
+  General,   // 1 + b1 z^-1 + b2 z^-2
+  Dc,        // 1 - z^-1
+  Dc2,       // (1 - z^-1)^2
+  Nyquist,   // 1 + z^-1
+  Nyquist2   // (1 + z^-1)^2
+};
+
+constexpr SOS_zeros sos_zeros_of(const SOS_Coefficients& c)
+{
+  const float b1 = c.b1, b2 = c.b2;
+  if (b2 == 0.f && (b1 == -1.f || b1 == 1.f))
+    return b1 < 0 ? SOS_zeros::Dc : SOS_zeros::Nyquist;
+  if (b2 == 1.f && (b1 == -2.f || b1 == 2.f))
+    return b1 < 0 ? SOS_zeros::Dc2 : SOS_zeros::Nyquist2;
+  return SOS_zeros::General;
+}
+
 /**
  * Envelops above asm functions into C++ class
  */
-template<std::size_t N>
+template<std::size_t N, typename T = sos_t>
 struct SOS_IIR_Filter {
   const sos_t gain;
   std::array<SOS_Coefficients, N> sos;
@@ -91,8 +128,14 @@ struct SOS_IIR_Filter {
     std::copy(_sos, _sos + N, sos.begin());
   }
 
+  constexpr SOS_IIR_Filter(const sos_t gain, const std::array<SOS_Coefficients, N>& _sos):
+    gain(gain), sos(_sos) {}
+
   void filter(auto samples, std::size_t n = N) {
-    for (auto [coeffs, ww] : std::views::zip(sos, w) | std::views::take(n)) {
+    for (std::size_t i = 0; i < n; i++) {
+        const auto& coeffs = sos[i];
+        auto& ww = w[i];
+
         // Assumes a0 and b0 coefficients are one (1.0)
         for (auto& s : samples) {
             auto f6 = s + coeffs.a1 * ww.w0 + coeffs.a2 * ww.w1;
@@ -114,21 +157,854 @@ struct SOS_IIR_Filter {
       auto f6 = s + coeffs.a1 * ww.w0 + coeffs.a2 * ww.w1;
       s = f6 + coeffs.b1 * ww.w0 + coeffs.b2 * ww.w1;
       ww.w1 = std::exchange(ww.w0, f6);
-      sum_sqr += s * gain * s * gain;
+      sum_sqr += s * s;
+    }
+
+    return sum_sqr * gain * gain;
+  }
+
+  // Same result as filter_sum_sqr(), but leaves the samples untouched so that
+  // several filters can read one block. Runs each sample through all sections.
+  // `tap` sees each output sample, before the gain.
+  template<typename Tap = sos_no_tap>
+  sos_t sum_sqr_of(const auto& samples, Tap tap = {}) {
+    sos_t sum_sqr (0.f);
+
+    for (sos_t s : samples) {
+      for (std::size_t i = 0; i < N; i++) {
+        const auto& coeffs = sos[i];
+        auto& ww = w[i];
+        auto f6 = s + coeffs.a1 * ww.w0 + coeffs.a2 * ww.w1;
+        s = f6 + coeffs.b1 * ww.w0 + coeffs.b2 * ww.w1;
+        ww.w1 = std::exchange(ww.w0, f6);
+      }
+      tap(s);
+      sum_sqr += s * s;
     }
 
-    return sum_sqr;
+    return sum_sqr * gain * gain;
   }
 };
 
-#endif  // SOS_IIR_FILTER_H
+// Signed 32x32->64 multiply from 16-bit halves. The Cortex-M0 has no SMULL,
+// so this is four MULS instead of a libgcc __aeabi_lmul call.
+constexpr int64_t sos_smull(int32_t a, int32_t b)
+{
+#if defined(NOISECARD_HOST)
+  return int64_t(a) * b;
+#else
+  const int32_t ah = a >> 16, bh = b >> 16;
+  const int32_t al = a & 0xFFFF, bl = b & 0xFFFF;
+  return (int64_t(ah * bh) << 32) + (int64_t(ah * bl) << 16) +
+    (int64_t(al * bh) << 16) + uint32_t(al) * uint32_t(bl);
+#endif
+}
+
+struct SOS_Coefficients_Q {
+  int32_t b1;
+  int32_t b2;
+  int32_t a1;
+  int32_t a2;
+  uint8_t q;    // Fractional bits, chosen per section to fit the largest coefficient
+  bool shaped;  // Error feedback for poles near DC
+};
+
+struct SOS_Delay_State_Q {
+  int32_t x1;
+  int32_t x2;
+  int32_t y1;
+  int32_t y2;
+  int32_t e;    // Quantization error carried into the next sample (shaped only)
+};
+
+// Fixed-point coefficients for each section of float filter f: Q2.30, or
+// fewer fractional bits where a coefficient needs more integer bits
+template<std::size_t N>
+constexpr std::array<SOS_Coefficients_Q, N> sos_quantize(const SOS_IIR_Filter<N>& f)
+{
+  std::array<SOS_Coefficients_Q, N> sos;
+
+  for (std::size_t i = 0; i < N; i++) {
+    const double c[4] = { f.sos[i].b1, f.sos[i].b2, f.sos[i].a1, f.sos[i].a2 };
+    double max = 1.;
+    for (auto x : c)
+      max = std::max(max, x < 0 ? -x : x);
+
+    // Sign bit plus enough integer bits to hold the largest coefficient
+    int q = 31;
+    while (q > 0 && max >= double(1u << (31 - q)))
+      q--;
+
+    const auto fix = [q](double x) {
+      x *= double(1ull << q);
+      return int32_t(x < 0 ? x - .5 : x + .5);
+    };
+
+    // Poles close to z = 1 amplify rounding noise at low frequencies
+    const double dc = 1. - c[2] - c[3];
+    sos[i] = { fix(c[0]), fix(c[1]), fix(c[2]), fix(c[3]), uint8_t(q),
+               (dc < 0 ? -dc : dc) < 1. / 32 };
+  }
+
+  return sos;
+}
+
+/**
+ * Unpacked float variant (SOS_UNPACKED): each value is a 32-bit mantissa and
+ * a separate exponent, so nothing is packed to IEEE format and unpacked again
+ * between operations. A value is m * 2^(e - SOS_U_BIAS), where the one's
+ * complement magnitude of m is in [2^28, 2^30) and e >= 0; zero is {0, 0}.
+ * The mantissa keeps more bits than a float's and two bits of headroom, so
+ * the three terms of each DF-II sum add without overflow and are normalized
+ * once.
+ *
+ * The firmware runs whole cascades in the Thumb-1 kernel of sos-unpacked.s,
+ * which keeps each section's delay state in registers across a block. The
+ * C++ functions below define the same arithmetic step for step and stand in
+ * for the kernel on the host; host/cascade-check runs both and compares them.
+ */
+struct sos_u {
+  int32_t m;
+  int32_t e;
+};
+
+static constexpr int32_t SOS_U_BIAS = 160;
+
+struct SOS_Coefficients_U {
+  int32_t b1;   // Mantissas, normalized as for sos_u, or zero
+  int32_t b2;
+  int32_t a1;
+  int32_t a2;
+  int32_t eb1;  // Exponents: a product with a sos_u of exponent e has
+  int32_t eb2;  // exponent e + eb1 (etc.) after the multiply's 32-bit shift
+  int32_t ea1;
+  int32_t ea2;
+};
+
+struct SOS_Delay_State_U {
+  int32_t m0;
+  int32_t e0;
+  int32_t m1;
+  int32_t e1;
+};
+
+// Arithmetic shift right as ARMv6-M does it: by the amount's low byte, and
+// filling with the sign bit from 32 on
+constexpr int32_t sos_u_asr(int32_t x, int32_t n)
+{
+  n &= 0xFF;
+  return n >= 32 ? x >> 31 : x >> n;
+}
+
+constexpr sos_u sos_u_normalize(int32_t m, int32_t e)
+{
+  auto t = uint32_t(m ^ (m >> 31));
+  if (t >> 28) {
+    if (t >> 30) {
+      m >>= 1;
+      e += 1;
+    }
+    return { m, e };
+  }
+  if (t == 0)
+    return { 0, 0 };
+
+  const int k = std::countl_zero(t) - 3;
+  m = int32_t(uint32_t(m) << k);
+  e -= k;
+  return e < 0 ? sos_u { 0, 0 } : sos_u { m, e };
+}
+
+constexpr sos_u sos_u_from_int(int32_t x)
+{
+  return sos_u_normalize(x, SOS_U_BIAS);
+}
+
+// Upper 32 bits of the product of two mantissas, from three 16x16 products
+constexpr int32_t sos_u_mul(int32_t x, int32_t y)
+{
+  const int32_t xh = x >> 16, yh = y >> 16;
+  const int32_t xl = x & 0xFFFF, yl = y & 0xFFFF;
+  return xh * yh + ((xh * yl + xl * yh) >> 16);
+}
+
+// Adds the product c * (wm, we) to the unnormalized sum (m, e), aligned to
+// the larger exponent
+constexpr void sos_u_mac(int32_t& m, int32_t& e, int32_t c, int32_t ec, int32_t wm, int32_t we)
+{
+  auto p = sos_u_mul(c, wm);
+  const auto pe = ec + we;
+  if (pe - e > 0) {
+    m = sos_u_asr(m, pe - e);
+    e = pe;
+  } else {
+    p = sos_u_asr(p, e - pe);
+  }
+  m += p;
+}
+
+// Adds y squared to the sum of squares `acc`
+constexpr void sos_u_square_add(sos_u& acc, sos_u y)
+{
+  auto p = sos_u_mul(y.m, y.m);
+  const auto pe = 2 * y.e - SOS_U_BIAS + 32;
+  if (pe - acc.e > 0) {
+    acc.m >>= std::min(pe - acc.e, 31);
+    acc.e = pe;
+  } else {
+    p >>= std::min(acc.e - pe, 31);
+  }
+  acc = sos_u_normalize(acc.m + p, acc.e);
+}
+
+constexpr float sos_u_to_float(sos_u v)
+{
+  if (v.m == 0)
+    return 0.f;
+  const auto f = std::bit_cast<uint32_t>(float(qfp_int2float_asm(v.m)));
+  const auto e = int32_t((f >> 23) & 0xFF) + v.e - SOS_U_BIAS;
+  if (e <= 0)
+    return 0.f;
+  return std::bit_cast<float>((f & 0x807FFFFFu) | uint32_t(std::min(e, 255)) << 23);
+}
+
+#if defined(NOISECARD_HOST)
+// Runs sections [0, n) over `count` samples. The first section reads `in`;
+// every section writes `out`, which may be `in`.
+inline void sos_u_cascade(const SOS_Coefficients_U *sos, SOS_Delay_State_U *w, unsigned n,
+                          const sos_u *in, sos_u *out, unsigned count)
+{
+  for (unsigned i = 0; i < n; i++, in = out) {
+    const auto& c = sos[i];
+    auto& ww = w[i];
+
+    // Assumes a0 and b0 coefficients are one (1.0)
+    for (unsigned j = 0; j < count; j++) {
+      auto [m, e] = in[j];
+      sos_u_mac(m, e, c.a1, c.ea1, ww.m0, ww.e0);
+      sos_u_mac(m, e, c.a2, c.ea2, ww.m1, ww.e1);
+      const auto f6 = sos_u_normalize(m, e);
+      m = f6.m;
+      e = f6.e;
+      sos_u_mac(m, e, c.b1, c.eb1, ww.m0, ww.e0);
+      sos_u_mac(m, e, c.b2, c.eb2, ww.m1, ww.e1);
+      out[j] = sos_u_normalize(m, e);
+      ww = { f6.m, f6.e, ww.m0, ww.e0 };
+    }
+  }
+}
+
+// Adds the squares of `count` samples to `acc`
+inline void sos_u_sum_sqr(const sos_u *x, unsigned count, sos_u *acc)
+{
+  for (unsigned j = 0; j < count; j++)
+    sos_u_square_add(*acc, x[j]);
+}
+#else
+extern "C" {
+void sos_u_cascade(const SOS_Coefficients_U *sos, SOS_Delay_State_U *w, unsigned n,
+                   const sos_u *in, sos_u *out, unsigned count);
+void sos_u_sum_sqr(const sos_u *x, unsigned count, sos_u *acc);
+}
+#endif
+
+template<std::size_t N>
+struct SOS_IIR_Filter<N, sos_u> {
+  const sos_t gain;
+  std::array<SOS_Coefficients_U, N> sos;
+  std::array<SOS_Delay_State_U, N> w {};
+
+  // Samples filtered per kernel call by sum_sqr_of(), which needs a copy
+  static constexpr unsigned CHUNK = 16;
+
+  constexpr SOS_IIR_Filter(const SOS_IIR_Filter<N, sos_t>& f):
+    gain(f.gain)
+  {
+    for (std::size_t i = 0; i < N; i++) {
+      const double c[4] = { f.sos[i].b1, f.sos[i].b2, f.sos[i].a1, f.sos[i].a2 };
+      int32_t m[4], e[4];
+      for (int j = 0; j < 4; j++) {
+        // Zero never becomes the larger exponent of a sum
+        m[j] = 0;
+        e[j] = -256;
+        if (c[j] == 0)
+          continue;
+
+        int k = 0;
+        double x = c[j] < 0 ? -c[j] : c[j];
+        while (x >= double(1 << 30)) { x /= 2; k--; }
+        while (x < double(1 << 28)) { x *= 2; k++; }
+        auto r = int64_t(x + .5);
+        if (r >= (int64_t(1) << 30)) { r >>= 1; k--; }
+        m[j] = int32_t(c[j] < 0 ? -r : r);
+        e[j] = 32 - k;
+      }
+      sos[i] = { m[0], m[1], m[2], m[3], e[0], e[1], e[2], e[3] };
+    }
+  }
+
+  void filter(auto samples) {
+    const auto data = std::ranges::data(samples);
+    sos_u_cascade(sos.data(), w.data(), N, data, data, unsigned(std::ranges::size(samples)));
+  }
+
+  sos_t filter_sum_sqr(auto samples) {
+    sos_u acc { 0, 0 };
+    filter(samples);
+    sos_u_sum_sqr(std::ranges::data(samples), unsigned(std::ranges::size(samples)), &acc);
+    return sos_t(sos_u_to_float(acc)) * gain * gain;
+  }
+
+  // Same result as filter_sum_sqr(), but leaves the samples untouched so that
+  // several filters can read one block. Filters CHUNK samples at a time into
+  // a copy. `tap` sees each output sample, before the gain.
+  template<typename Tap = sos_no_tap>
+  sos_t sum_sqr_of(const auto& samples, Tap tap = {}) {
+    const sos_u *data = std::ranges::data(samples);
+    auto left = unsigned(std::ranges::size(samples));
+    sos_u acc { 0, 0 };
+    std::array<sos_u, CHUNK> out;
+
+    while (left > 0) {
+      const auto n = std::min(left, CHUNK);
+      const sos_u *y = data;
+      if constexpr (N > 0) {
+        sos_u_cascade(sos.data(), w.data(), N, data, out.data(), n);
+        y = out.data();
+      }
+      for (unsigned j = 0; j < n; j++)
+        tap(y[j]);
+      sos_u_sum_sqr(y, n, &acc);
+      data += n;
+      left -= n;
+    }
+
+    return sos_t(sos_u_to_float(acc)) * gain * gain;
+  }
+};
+
+// Converts a filter declaration to the given sample type at compile time.
+template<typename T, std::size_t N>
+constexpr SOS_IIR_Filter<N, T> sos_filter_cast(const SOS_IIR_Filter<N>& f)
+{
+  return f;
+}
+
+// Returns filter f with its gain multiplied by g, e.g. to carry the gain of
+// a preceding filter that is run without one.
+template<std::size_t N>
+constexpr SOS_IIR_Filter<N> sos_scaled(const SOS_IIR_Filter<N>& f, sos_t g)
+{
+  return { sos_t(float(double(float(f.gain)) * double(float(g)))), f.sos };
+}
+
+// Returns filter f without its first K sections, e.g. when those are run
+// elsewhere. The gain is kept.
+template<std::size_t K, std::size_t N>
+constexpr SOS_IIR_Filter<N - K> sos_tail(const SOS_IIR_Filter<N>& f)
+{
+  std::array<SOS_Coefficients, N - K> sos;
+  std::copy(f.sos.begin() + K, f.sos.end(), sos.begin());
+  return { f.gain, sos };
+}
+
+// Calls f with std::integral_constant 0 through K - 1, e.g. to unroll a
+// filter's sections
+template<std::size_t K>
+void sos_sections(auto f)
+{
+  [&f]<std::size_t... I>(std::index_sequence<I...>) {
+    (f(std::integral_constant<std::size_t, I>()), ...);
+  }(std::make_index_sequence<K>());
+}
+
+/**
+ * SOS_IIR_Filter with its coefficients fixed at compile time: F is a
+ * constexpr filter declaration, and only the delay state is kept at run
+ * time. Sections are unrolled with their coefficients as constants, and a
+ * coefficient of 0, 1 or 2 (or -1, -2) costs an add or subtract instead of
+ * a multiply, e.g. for a DC blocker's b1 = -1, b2 = a2 = 0. Outputs and
+ * sums equal SOS_IIR_Filter's. T = int32_t gives the fixed-point variant.
+ */
+template<const auto& F, typename T = sos_t>
+struct SOS_IIR_Static {
+  static constexpr std::size_t N = F.sos.size();
+  static constexpr sos_t gain = F.gain;
+  std::array<SOS_Delay_State, N> w {};
+
+  void filter(auto samples) {
+    filter_sections<N>(samples);
+  }
+
+  sos_t filter_sum_sqr(auto samples) {
+    sos_t sum_sqr (0.f);
+
+    filter_sections<N - 1>(samples);
+
+    for (auto& s : samples) {
+      s = step<N - 1>(w.back(), s);
+      sum_sqr += s * s;
+    }
+
+    return sum_sqr * gain * gain;
+  }
+
+  // As SOS_IIR_Filter::sum_sqr_of()
+  template<typename Tap = sos_no_tap>
+  sos_t sum_sqr_of(const auto& samples, Tap tap = {}) {
+    sos_t sum_sqr (0.f);
+
+    for (sos_t s : samples) {
+      sos_sections<N>([&](auto i) { s = step<i>(w[i], s); });
+      tap(s);
+      sum_sqr += s * s;
+    }
+
+    return sum_sqr * gain * gain;
+  }
+
+private:
+  // Runs the first K sections over the samples, one section at a time
+  template<std::size_t K>
+  void filter_sections(auto samples) {
+    sos_sections<K>([&](auto i) {
+      for (auto& s : samples)
+        s = step<i>(w[i], s);
+    });
+  }
+
+  // s + C * x, rounded as if multiplied: scaling by 1 or 2 is exact
+  template<float C>
+  static sos_t mac(sos_t s, sos_t x) {
+    if constexpr (C == 0.f)
+      return s;
+    else if constexpr (C == 1.f)
+      return s + x;
+    else if constexpr (C == -1.f)
+      return s - x;
+    else if constexpr (C == 2.f)
+      return s + (x + x);
+    else if constexpr (C == -2.f)
+      return s - (x + x);
+    else
+      return s + sos_t(C) * x;
+  }
+
+  // Assumes a0 and b0 coefficients are one (1.0)
+  template<std::size_t I>
+  static sos_t step(SOS_Delay_State& ww, sos_t s) {
+    constexpr auto& c = F.sos[I];
+    const auto f6 = mac<float(c.a2)>(mac<float(c.a1)>(s, ww.w0), ww.w1);
+    s = mac<float(c.b2)>(mac<float(c.b1)>(f6, ww.w0), ww.w1);
+    ww.w1 = std::exchange(ww.w0, f6);
+    return s;
+  }
+};
+
+/**
+ * Fixed-point variant: integer samples, Q2.30 (or wider) coefficients and
+ * 64-bit accumulators. Direct form I is used so that the delay state never
+ * exceeds the section's output level. Each section's coefficients, shift and
+ * error shaping are constants, so its 64-bit shifts take immediate counts.
+ */
+template<const auto& F>
+struct SOS_IIR_Static<F, int32_t> {
+  static constexpr std::size_t N = F.sos.size();
+  static constexpr auto sos = sos_quantize(F);
+  static constexpr sos_t gain = F.gain;
+  static constexpr sos_t gain_sqr = float(F.gain) * float(F.gain);
+
+  // Most samples one sum of squares can take: outputs stay below 2^27 with
+  // SAMPLE_SHIFT headroom, so 2^9 of their squares fit in 64 bits
+  static constexpr std::size_t max_block = 512;
+
+  std::array<SOS_Delay_State_Q, N> w {};
+
+  void filter(auto samples) {
+    filter_sections<N>(samples);
+  }
+
+  sos_t filter_sum_sqr(auto samples) {
+    uint64_t sum_sqr = 0;
+
+    filter_sections<N - 1>(samples);
+
+    for (auto& s : samples) {
+      s = step<N - 1>(w.back(), s);
+      sum_sqr += uint64_t(sos_smull(s, s));
+    }
+
+    return to_sum_sqr(sum_sqr);
+  }
+
+  // Same result as filter_sum_sqr(), but leaves the samples untouched so that
+  // several filters can read one block. Runs each sample through all sections.
+  // `tap` sees each output sample, before the gain.
+  template<typename Tap = sos_no_tap>
+  sos_t sum_sqr_of(const auto& samples, Tap tap = {}) {
+    uint64_t sum_sqr = 0;
+
+    for (int32_t s : samples) {
+      sos_sections<N>([&](auto i) { s = step<i>(w[i], s); });
+      tap(s);
+      sum_sqr += uint64_t(sos_smull(s, s));
+    }
+
+    return to_sum_sqr(sum_sqr);
+  }
+
+private:
+  template<std::size_t K>
+  void filter_sections(auto samples) {
+    sos_sections<K>([&](auto i) {
+      for (auto& s : samples)
+        s = step<i>(w[i], s);
+    });
+  }
+
+  // Assumes a0 and b0 coefficients are one (1.0)
+  template<std::size_t I>
+  static int32_t step(SOS_Delay_State_Q& ww, int32_t s) {
+    constexpr auto& c = sos[I];
+    constexpr unsigned q = c.q;
+    constexpr uint32_t mask = (uint32_t(1) << q) - 1;
+    constexpr int32_t round = int32_t(1) << (q - 1);
+    static_assert(q > 0);
+
+    const int64_t acc = (int64_t(s) << q) + (c.shaped ? ww.e : round) +
+      sos_smull(c.b1, ww.x1) + sos_smull(c.b2, ww.x2) +
+      sos_smull(c.a1, ww.y1) + sos_smull(c.a2, ww.y2);
+    ww.x2 = std::exchange(ww.x1, s);
+    s = int32_t(acc >> q);
+    ww.y2 = std::exchange(ww.y1, s);
+    if constexpr (c.shaped)
+      ww.e = int32_t(uint32_t(acc) & mask);
+    return s;
+  }
+
+  static sos_t to_sum_sqr(uint64_t sum_sqr) {
+    const auto hi = qfp_uint2float(uint32_t(sum_sqr >> 32));
+    const auto lo = qfp_uint2float(uint32_t(sum_sqr));
+    return (sos_t(hi) * 4294967296.f + lo) * gain_sqr;
+  }
+};
+
+namespace sos_detail {
+  struct root {
+    double re;
+    double im;
+  };
+
+  constexpr double sqrt(double x) {
+    if (x <= 0)
+      return 0;
+    double r = x < 1 ? 1 : x;
+    for (int i = 0; i < 100; i++) {
+      const double n = (r + x / r) / 2;
+      if (n >= r)
+        break;
+      r = n;
+    }
+    return r;
+  }
+
+  constexpr double dist(const root& a, const root& b) {
+    const double re = a.re - b.re, im = a.im - b.im;
+    return sqrt(re * re + im * im);
+  }
+
+  // Roots of z^2 + p*z + q; a first-order polynomial (q = 0) gives a root
+  // at the origin as its second.
+  constexpr std::array<root, 2> roots(double p, double q) {
+    const double disc = p * p - 4 * q;
+    if (disc < 0)
+      return {{ { -p / 2, sqrt(-disc) / 2 }, { -p / 2, -sqrt(-disc) / 2 } }};
+
+    // Numerically stable form; the second root follows from q
+    const double r1 = (p < 0 ? -p + sqrt(disc) : -p - sqrt(disc)) / 2;
+    return {{ { r1, 0 }, { r1 != 0 ? q / r1 : 0, 0 } }};
+  }
+
+  constexpr double radius(const std::array<root, 2>& r) {
+    double m = 0;
+    for (const auto& x : r)
+      m = std::max(m, sqrt(x.re * x.re + x.im * x.im));
+    return m;
+  }
+
+  // Total distance between two root pairs under their best matching
+  constexpr double distance(const std::array<root, 2>& a, const std::array<root, 2>& b) {
+    return std::min(dist(a[0], b[0]) + dist(a[1], b[1]),
+                    dist(a[0], b[1]) + dist(a[1], b[0]));
+  }
+
+  // One polynomial of a section: {b1, b2} or {a1, a2}
+  struct poly {
+    sos_t c1;
+    sos_t c2;
+  };
+
+  // Multiplies first-order polynomials together in pairs so that they share
+  // a section. Denominators are stored negated, which flips the sign of the
+  // product term. Returns the new count.
+  constexpr std::size_t merge_first_order(poly *p, std::size_t n, double sign) {
+    for (std::size_t i = 0; i < n; i++) {
+      if (float(p[i].c2) != 0.f)
+        continue;
+      for (std::size_t j = i + 1; j < n; j++) {
+        if (float(p[j].c2) == 0.f) {
+          p[i] = { sos_t(float(double(p[i].c1) + double(p[j].c1))),
+                   sos_t(float(sign * double(p[i].c1) * double(p[j].c1))) };
+          std::copy(p + j + 1, p + n, p + j);
+          n--;
+          break;
+        }
+      }
+    }
+    return n;
+  }
+
+  template<std::size_t G>
+  struct pairing {
+    std::array<SOS_Coefficients, G> sos {};
+    std::size_t count = 0;
+  };
+
+  // Re-pairs the numerators and denominators of a cascade. Denominators are
+  // taken in order of pole radius, most resonant first, and each is given
+  // the numerator whose zeros lie closest to its poles. Keeping near-equal
+  // poles and zeros together keeps every intermediate output close to the
+  // input level. The designed coefficients themselves are left untouched,
+  // apart from first-order polynomials being merged to save sections.
+  template<std::size_t G>
+  constexpr pairing<G> repair(const SOS_Coefficients *in, std::size_t n) {
+    poly nums[G] {}, dens[G] {};
+    for (std::size_t i = 0; i < n; i++) {
+      nums[i] = { in[i].b1, in[i].b2 };
+      dens[i] = { in[i].a1, in[i].a2 };
+    }
+
+    const auto nn = merge_first_order(nums, n, 1);
+    const auto nd = merge_first_order(dens, n, -1);
+
+    pairing<G> out;
+    out.count = std::max(nn, nd);
+    bool nused[G] {}, dused[G] {};
+    for (std::size_t k = 0; k < out.count; k++) {
+      // Leftover numerators or denominators pair with unity (zero coefficients)
+      std::array<root, 2> pr {{ { 0, 0 }, { 0, 0 } }};
+      poly den {};
+      int d = -1;
+      for (std::size_t i = 0; i < nd; i++) {
+        if (!dused[i] && (d < 0 ||
+            radius(roots(-double(dens[i].c1), -double(dens[i].c2))) >
+            radius(roots(-double(dens[d].c1), -double(dens[d].c2)))))
+          d = i;
+      }
+      if (d >= 0) {
+        dused[d] = true;
+        den = dens[d];
+        pr = roots(-double(den.c1), -double(den.c2));
+      }
+
+      poly num {};
+      int z = -1;
+      for (std::size_t i = 0; i < nn; i++) {
+        if (!nused[i] && (z < 0 ||
+            distance(roots(nums[i].c1, nums[i].c2), pr) <
+            distance(roots(nums[z].c1, nums[z].c2), pr)))
+          z = i;
+      }
+      if (z >= 0) {
+        nused[z] = true;
+        num = nums[z];
+      }
+
+      out.sos[k] = { num.c1, num.c2, den.c1, den.c2 };
+    }
+
+    return out;
+  }
+}
+
+/**
+ * Fuses the given filters, in order, into a single cascade at compile time.
+ * The gains are folded into one, and poles and zeros are re-paired across
+ * all sections (see sos_detail::repair()). With one filter this only
+ * re-pairs it.
+ */
+template<const auto&... F>
+constexpr auto sos_cascade()
+{
+  constexpr std::size_t G = (F.sos.size() + ...);
+  constexpr auto fused = []{
+    std::array<SOS_Coefficients, G> in {};
+    auto it = in.begin();
+    ((it = std::copy(F.sos.begin(), F.sos.end(), it)), ...);
+    return sos_detail::repair<G>(in.data(), G);
+  }();
+
+  std::array<SOS_Coefficients, fused.count> sos {};
+  std::copy(fused.sos.begin(), fused.sos.begin() + fused.count, sos.begin());
+  return SOS_IIR_Filter<fused.count>(
+    sos_t(float((double(float(F.gain)) * ...))), sos);
+}
+
+namespace sos_detail {
+  constexpr double pi = 3.14159265358979323846;
+
+  constexpr double sin(double x) {
+    // Reduce to [-pi, pi], then Taylor series
+    const double turns = x / (2 * pi);
+    x -= 2 * pi * double(static_cast<long long>(turns + (turns < 0 ? -0.5 : 0.5)));
+    double term = x, sum = x;
+    for (int n = 1; n < 20; n++) {
+      term *= -x * x / ((2 * n) * (2 * n + 1));
+      sum += term;
+    }
+    return sum;
+  }
+
+  constexpr double cos(double x) {
+    return sin(x + pi / 2);
+  }
+
+  // Maps the analog pole at s = -2*pi*f onto the z-plane by the bilinear
+  // transform. The corner is prewarped so that it lands on the same
+  // frequency after warping; corners too close to Nyquist for that are
+  // mapped as-is.
+  constexpr double bilinear_pole(double f, double fs) {
+    const double k = 2 * fs;
+    const double w = f < 0.4 * fs ? k * sin(pi * f / fs) / cos(pi * f / fs)
+                                   : 2 * pi * f;
+    return (k - w) / (k + w);
+  }
+
+  // Section with a double zero at z (+1 or -1) and real poles p and q
+  constexpr SOS_Coefficients section(double z, double p, double q) {
+    return { sos_t(float(-2 * z)), sos_t(1.f),
+             sos_t(float(p + q)), sos_t(float(-p * q)) };
+  }
+}
+
+/**
+ * Magnitude response of filter f, including its gain, at freq Hz for a
+ * sample rate of fs Hz.
+ */
+template<std::size_t N>
+constexpr double sos_magnitude(const SOS_IIR_Filter<N>& f, double freq, double fs)
+{
+  using sos_detail::sqrt;
+  const double w = 2 * sos_detail::pi * freq / fs;
+  const double c1 = sos_detail::cos(w), s1 = sos_detail::sin(w);
+  const double c2 = sos_detail::cos(2 * w), s2 = sos_detail::sin(2 * w);
+
+  double mag = float(f.gain);
+  for (const auto& c : f.sos) {
+    // (z^2 + b1 z + b2) / (z^2 - a1 z - a2) in the stored sign convention
+    const double nr = c2 + float(c.b1) * c1 + float(c.b2), ni = s2 + float(c.b1) * s1;
+    const double dr = c2 - float(c.a1) * c1 - float(c.a2), di = s2 - float(c.a1) * s1;
+    mag *= sqrt((nr * nr + ni * ni) / (dr * dr + di * di));
+  }
+  return mag;
+}
+
+/**
+ * True if every section's poles lie strictly inside the unit circle.
+ */
+template<std::size_t N>
+constexpr bool sos_stable(const SOS_IIR_Filter<N>& f)
+{
+  // Stability triangle for 1 + a1 z^-1 + a2 z^-2, where a1 = -c.a1, a2 = -c.a2
+  return std::ranges::all_of(f.sos, [](const SOS_Coefficients& c) {
+    const double a1 = -double(float(c.a1)), a2 = -double(float(c.a2));
+    return a2 < 1 && a2 > -1 && a1 < 1 + a2 && -a1 < 1 + a2;
+  });
+}
+
+/**
+ * Returns filter f with each numerator that is within `tolerance`, in both
+ * coefficients, of one of the SOS_zeros forms set to that form exactly, so
+ * that SOS_IIR_Static runs it without multiplies. The gain is corrected to keep the
+ * response at 1 kHz; how far the response moves elsewhere is up to the
+ * tolerance, and can be checked with sos_magnitude().
+ */
+template<std::size_t N>
+constexpr SOS_IIR_Filter<N> sos_snap_zeros(const SOS_IIR_Filter<N>& f, double tolerance, double fs)
+{
+  constexpr float forms[][2] = { { -1, 0 }, { -2, 1 }, { 1, 0 }, { 2, 1 } };
+  auto sos = f.sos;
+  for (auto& c : sos) {
+    for (const auto& [b1, b2] : forms) {
+      const double d1 = double(float(c.b1)) - b1, d2 = double(float(c.b2)) - b2;
+      if (d1 <= tolerance && -d1 <= tolerance && d2 <= tolerance && -d2 <= tolerance) {
+        c.b1 = b1;
+        c.b2 = b2;
+      }
+    }
+  }
+
+  const SOS_IIR_Filter<N> snapped (f.gain, sos);
+  const double g = double(float(f.gain)) * sos_magnitude(f, 1000, fs) /
+    sos_magnitude(snapped, 1000, fs);
+  return { sos_t(float(g)), sos };
+}
+
+// True if any of f's numerators is one of the SOS_zeros forms
+template<std::size_t N>
+constexpr bool sos_has_zeros(const SOS_IIR_Filter<N>& f)
+{
+  return std::ranges::any_of(f.sos, [](const SOS_Coefficients& c) {
+    return sos_zeros_of(c) != SOS_zeros::General;
+  });
+}
+
+enum class Weighting { A, C, Z };
+
+/**
+ * Designs an IEC 61672-1 frequency weighting for a sample rate of Fs Hz at
+ * compile time: the analog prototype's poles are mapped by the prewarped
+ * bilinear transform, grouped into sections, and the gain set for 0 dB at
+ * 1 kHz. Z-weighting is flat and has no sections.
+ */
+template<Weighting W, unsigned Fs>
+constexpr auto sos_weighting()
+{
+  constexpr std::size_t N = W == Weighting::A ? 3 : W == Weighting::C ? 2 : 0;
+  constexpr auto f = []{
+    using sos_detail::bilinear_pole;
+    using sos_detail::section;
+
+    // Pole frequencies from IEC 61672-1 Annex E
+    const double p1 = bilinear_pole(20.598997, Fs);
+    const double p2 = bilinear_pole(107.65265, Fs);
+    const double p3 = bilinear_pole(737.86223, Fs);
+    const double p4 = bilinear_pole(12194.217, Fs);
+
+    // Zeros at s = 0 go to z = 1; the excess poles bring zeros at z = -1
+    std::array<SOS_Coefficients, N> sos {};
+    if constexpr (W == Weighting::A)
+      sos = {{ section(1, p1, p1), section(1, p2, p3), section(-1, p4, p4) }};
+    else if constexpr (W == Weighting::C)
+      sos = {{ section(1, p1, p1), section(-1, p4, p4) }};
+
+    const SOS_IIR_Filter<N> unity (sos_t(1.f), sos);
+    return SOS_IIR_Filter<N>(sos_t(float(1 / sos_magnitude(unity, 1000, Fs))), sos);
+  }();
+
+  static_assert(sos_stable(f), "weighting filter has poles outside the unit circle");
+  static_assert(sos_magnitude(f, 1000, Fs) > 0.9988 && sos_magnitude(f, 1000, Fs) < 1.0012,
+    "weighting filter is not within 0.01 dB of unity at 1 kHz");
+  return f;
+}
+
 
 // Knowles SPH0645LM4H-B, rev. B
 // https://cdn-shop.adafruit.com/product-files/3421/i2S+Datasheet.PDF
 // B ~= [1.001234, -1.991352, 0.990149]
 // A ~= [1.0, -1.993853, 0.993863]
 // With additional DC blocking component
-SOS_IIR_Filter SPH0645LM4H_B_RB = {
+constexpr SOS_IIR_Filter SPH0645LM4H_B_RB = {
   /* gain: */ sos_t(1.00123377961525f),
   /* sos: */ { // Second-Order Sections {b1, b2, -a1, -a2}
          { sos_t(-1.0f), sos_t(0.0f),
@@ -137,12 +1013,36 @@ SOS_IIR_Filter SPH0645LM4H_B_RB = {
            sos_t(+1.993853376183491f), sos_t(-0.993862821429572f) } }
 };
 
+// TDK/InvenSense ICS-43434
+// https://invensense.tdk.com/wp-content/uploads/2016/02/DS-000069-ICS-43434-v1.2.pdf
+// B = [0.477326418836803, -0.486486982406126, -0.336455844522277, 0.234624646917202, 0.111023257388606]
+// A = [1.0, -1.93073383849136326, 0.86519456089576796, 0.06442838283698954, 0.00111249298800616]
+constexpr SOS_IIR_Filter ICS43434 = {
+  /* gain: */ sos_t(0.477326418836803f),
+  /* sos: */ { // Second-Order Sections {b1, b2, -a1, -a2}
+         { sos_t(+0.96986791463971267f), sos_t(+0.23515976355743193f),
+           sos_t(-0.06681948004769928f), sos_t(-0.00111521990688128f) },
+         { sos_t(-1.98905931743624453f), sos_t(+0.98908924206960169f),
+           sos_t(+1.99755331853906037f), sos_t(-0.99755481510122113f) } }
+};
+
+// TDK/InvenSense INMP441
+// https://invensense.tdk.com/wp-content/uploads/2015/02/INMP441.pdf
+// B ~= [1.00198, -1.99085, 0.98892]
+// A ~= [1.0, -1.99518, 0.99518]
+constexpr SOS_IIR_Filter<1> INMP441 = {
+  /* gain: */ sos_t(1.00197834654696f),
+  /* sos: */ {{ // Second-Order Section {b1, b2, -a1, -a2}
+         { sos_t(-1.986920458344451f), sos_t(+0.986963226946616f),
+           sos_t(+1.995178510504166f), sos_t(-0.995184322194091f) } }}
+};
+
 //
 // A-weighting IIR Filter, Fs = 48KHz
 // (By Dr. Matt L., Source: https://dsp.stackexchange.com/a/36122)
 // B = [0.169994948147430, 0.280415310498794, -1.120574766348363, 0.131562559965936, 0.974153561246036, -0.282740857326553, -0.152810756202003]
 // A = [1.0, -2.12979364760736134, 0.42996125885751674, 1.62132698199721426, -0.96669962900852902, 0.00121015844426781, 0.04400300696788968]
-SOS_IIR_Filter A_weighting = {
+constexpr SOS_IIR_Filter A_weighting = {
   /* gain: */ sos_t(0.169994948147430f),
   /* sos: */ { // Second-Order Sections {b1, b2, -a1, -a2}
          { sos_t(-2.00026996133106f), sos_t(+1.00027056142719f),
@@ -153,15 +1053,6 @@ SOS_IIR_Filter A_weighting = {
            sos_t(+1.982242159753048f), sos_t(-0.982298594928989f) } }
 };
 
-////
-//// C-weighting IIR Filter, Fs = 48KHz
-//// Designed by invfreqz curve-fitting, see respective .m file
-//// B = [-0.49164716933714026, 0.14844753846498662, 0.74117815661529129, -0.03281878334039314, -0.29709276192593875, -0.06442545322197900, -0.00364152725482682]
-//// A = [1.0, -1.0325358998928318, -0.9524000181023488, 0.8936404694728326   0.2256286147169398  -0.1499917107550188, 0.0156718181681081]
-//SOS_IIR_Filter C_weighting = {
-//  gain: -0.491647169337140,
-//  sos: {
-//    { +1.4604385758204708, +0.5275070373815286, +1.9946144559930252, -0.9946217070140883 },
-//    { +0.2376222404939509, +0.0140411206016894, -1.3396585608422749, -0.4421457807694559 },
-//    { -2.0000000000000000, +1.0000000000000000, +0.3775800047420818, -0.0356365756680430 } }
-//};
+// C-weighting and Z-weighting for any sample rate: see sos_weighting().
+
+#endif  // SOS_IIR_FILTER_H